@@ -1,6 +1,11 @@
 #ifndef SYNCTIME_H
 #define SYNCTIME_H
 
+#ifdef SYNCTIME_HOST
+/* Native build of the pure modules (make host-test): types only */
+#include "host_shim.h"
+#else
+
 /* AmigaOS system includes */
 #include <exec/types.h>
 #include <exec/memory.h>
@@ -13,6 +18,7 @@
 #include <libraries/gadtools.h>
 #include <libraries/commodities.h>
 #include <devices/timer.h>
+#include <resources/battclock.h>
 
 #include <proto/exec.h>
 #include <proto/dos.h>
@@ -20,6 +26,7 @@
 #include <proto/gadtools.h>
 #include <proto/commodities.h>
 #include <proto/timer.h>
+#include <proto/battclock.h>
 #include <proto/utility.h>
 #include <clib/alib_protos.h>
 
@@ -42,6 +49,8 @@
 #include <proto/listbrowser.h>
 #include <proto/label.h>
 
+#endif /* SYNCTIME_HOST */
+
 #include <string.h>
 
 /* =========================================================================
@@ -55,6 +64,15 @@
 #define NTP_PACKET_SIZE    48
 #define NTP_VERSION        3
 #define NTP_MODE_CLIENT    3
+#define NTP_MODE_SERVER    4
+#define NTP_MODE_BROADCAST 5
+
+/* Kiss-of-Death codes from a stratum 0 reply's reference ID */
+#define KISS_NONE          0       /* Not a Kiss-of-Death */
+#define KISS_RATE          1       /* Polling too often; slow down */
+#define KISS_DENY          2       /* Access denied; stop querying */
+#define KISS_RSTR          3       /* Access restricted; stop querying */
+#define KISS_OTHER         4       /* Any other code; ignored */
 
 /* Epoch offset: seconds from Jan 1 1900 (NTP) to Jan 1 1978 (Amiga) */
 #define NTP_TO_AMIGA_EPOCH 2461449600UL
@@ -64,14 +82,43 @@
 #define DEFAULT_INTERVAL   3600
 #define DEFAULT_TIMEZONE   "America/Los_Angeles"
 #define SERVER_NAME_MAX    128
+#define MAX_SERVER_ADDRS   8       /* Addresses queried concurrently per sync */
+#define QUERY_TIMEOUT_MS   5000    /* Time allowed for replies to arrive */
+#define DEFAULT_BURST      1       /* Requests per address per sync */
+#define MAX_BURST          8
+#define BURST_SPACING_MS   2000    /* Between requests of a burst, as NTP's iburst */
+#define WAIT_FOREVER       0xFFFFFFFFUL  /* network_wait() timeout: no limit */
 #define MIN_INTERVAL       60
 #define MAX_INTERVAL       86400
-#define RETRY_INTERVAL     30      /* Seconds between retries after first success */
-#define STARTUP_RETRY_INTERVAL 1   /* Seconds between retries before first success */
+#define DEFAULT_DNS_TTL    3600    /* Seconds a DNS lookup is reused; 0 = never */
+#define MAX_DNS_TTL        86400
+#define DEFAULT_SLEW_LIMIT 1000    /* ms; larger offsets step the clock */
+#define MAX_SLEW_LIMIT     600000
+#define DEFAULT_MAX_INTERVAL 14400  /* Adaptive poll ceiling, seconds */
+#define DEFAULT_TOLERANCE  100     /* ms of residual offset before polling faster */
+#define MAX_TOLERANCE      10000
+#define MAX_DRIFT_PPB      500000  /* 500 ppm, as in RFC 5905 */
+#define RETRY_INTERVAL     30      /* First retry after a failed sync; backs off to the poll interval */
+#define STARTUP_RETRY_INTERVAL 1   /* Seconds between network probes before first success */
+#define STARTUP_RETRY_MAX  64      /* Backoff ceiling for failed syncs before first success */
+#define NETWORK_PROBE_MAX  60      /* Seconds of failed probes before trying a sync anyway */
+#define ONCE_TIMEOUT       30      /* ONCE: default seconds for the network and the sync */
+#define LOG_PATH_MAX       64      /* LOGFILE= path, empty = no log file */
+#define DEFAULT_LISTEN_DELAY 4     /* ms one-way broadcast delay, as ntpd */
+#define MAX_LISTEN_DELAY   1000
+#define LISTEN_GRACE_SECS  180     /* Wait for a first broadcast before querying */
+
+/* Log levels; messages above the configured LOGLEVEL are dropped */
+#define LOG_ERROR          0
+#define LOG_WARN           1
+#define LOG_INFO           2
+#define LOG_DEBUG          3
+#define DEFAULT_LOG_LEVEL  LOG_INFO
 
 /* Prefs file paths */
 #define PREFS_ENV_PATH     "ENV:SyncTime.prefs"
 #define PREFS_ENVARC_PATH  "ENVARC:SyncTime.prefs"
+#define STATE_ENVARC_PATH  "ENVARC:SyncTime.state"  /* Drift, survives reboots */
 
 /* Commodity */
 #define CX_NAME            "SyncTime"
@@ -94,8 +141,31 @@ typedef struct {
     char  server[SERVER_NAME_MAX];
     LONG  interval;     /* seconds between syncs */
     char  tz_name[48];  /* IANA timezone name, e.g. "America/Los_Angeles" */
+    LONG  dns_ttl;      /* seconds to reuse resolved addresses, 0 = off */
+    BOOL  slew;         /* apply small offsets gradually */
+    LONG  slew_limit;   /* ms; offsets above this are stepped */
+    BOOL  drift;        /* learn and compensate clock drift */
+    BOOL  battclock;    /* write synced time back to the battery clock */
+    LONG  max_interval; /* seconds; adaptive poll ceiling */
+    LONG  tolerance;    /* ms of residual offset allowed before polling faster */
+    LONG  burst;        /* requests per address per sync, filtered */
+    BOOL  listen;       /* take time from broadcasts on port 123 */
+    LONG  listen_delay; /* ms one-way delay assumed for broadcasts */
+    BOOL  listen_cal;   /* measure that delay with one query instead */
+    BOOL  serve;        /* answer LAN SNTP requests on port 123 */
+    LONG  log_level;    /* LOG_*; more verbose messages are dropped */
+    char  log_file[LOG_PATH_MAX];  /* Log file path, empty = window only */
 } SyncConfig;
 
+/* What drift.c learned, kept in STATE_ENVARC_PATH across reboots */
+typedef struct {
+    ULONG batt_set_secs;    /* Local time the battery clock was last set, 0 = never */
+    BOOL  have_drift;
+    LONG  drift_ppb;        /* System clock drift, ns per second */
+    BOOL  have_batt_drift;
+    LONG  batt_drift_ppb;   /* Battery clock drift, ns per second */
+} ClockState;
+
 typedef struct {
     int   status;              /* STATUS_* */
     ULONG last_sync_secs;      /* Amiga time of last successful sync */
@@ -103,25 +173,97 @@ typedef struct {
     char  status_text[64];     /* Human-readable status */
     char  last_sync_text[32];  /* Formatted last sync time */
     char  next_sync_text[32];  /* Formatted next sync time */
+    char  stats_text[64];      /* Statistics summary */
 } SyncStatus;
 
-/* Timezone entry from generated tz_table.c */
+/* Amiga system time with microseconds (Amiga epoch, local time) */
+typedef struct {
+    ULONG secs;
+    ULONG micro;
+} AmigaTime;
+
+/* Raw 64-bit NTP timestamp: seconds since 1900 plus 2^-32 fractions */
+typedef struct {
+    ULONG secs;
+    ULONG frac;
+} NTPTimestamp;
+
+/* Signed clock offset. The value is secs + micro / 1000000 with micro
+ * always in 0..999999, so -0.25 s is stored as secs = -1, micro = 750000. */
+typedef struct {
+    LONG  secs;
+    ULONG micro;
+} ClockOffset;
+
+/* Fields of interest from a server response packet */
+typedef struct {
+    UBYTE        mode;
+    UBYTE        stratum;
+    BYTE         poll;      /* log2 of the poll interval the server wants */
+    ULONG        refid;     /* Reference ID; the kiss code at stratum 0 */
+    NTPTimestamp origin;    /* t1: our transmit timestamp, echoed back */
+    NTPTimestamp receive;   /* t2: server receive time (UTC) */
+    NTPTimestamp transmit;  /* t3: server transmit time (UTC) */
+} SNTPResponse;
+
+/* What a reply from our own server mode says about our clock */
+typedef struct {
+    UBYTE     leap;              /* 0, or 3 = not synchronized */
+    UBYTE     stratum;           /* Upstream stratum + 1, 16 = unsynchronized */
+    BYTE      precision;         /* log2 seconds */
+    ULONG     refid;             /* Upstream server's IPv4 address */
+    ULONG     root_delay_micro;  /* Round trip to the upstream server */
+    ULONG     root_disp_micro;   /* Error bound grown since the last sync */
+    AmigaTime ref_time;          /* Local time of the last sync */
+} SNTPServerInfo;
+
+/* Result of one request/response exchange */
+typedef struct {
+    ClockOffset offset;       /* Correction to add to the local clock */
+    LONG        delay_micro;  /* Round-trip delay in microseconds */
+    UBYTE       stratum;
+} SNTPSample;
+
+/* What a TZRule transition hour is measured in, as tzdb's AT suffix */
+#define TZ_AT_WALL  0   /* Local time in effect before the change */
+#define TZ_AT_STD   1   /* Local standard time ('s') */
+#define TZ_AT_UTC   2   /* UTC ('u') */
+
+/* DST rule from generated tz_table.c, shared by every zone using it */
 typedef struct {
-    const char *name;       /* Full name: "America/Los_Angeles" */
-    const char *region;     /* Region: "America" */
-    const char *city;       /* City: "Los_Angeles" */
-    WORD std_offset_mins;   /* Standard offset from UTC in minutes */
-    WORD dst_offset_mins;   /* Additional DST offset (0 if no DST) */
+    WORD  dst_offset_mins;  /* Additional DST offset (0 if no DST) */
     UBYTE dst_start_month;  /* 1-12, 0 = no DST */
     UBYTE dst_start_week;   /* 1-5, which occurrence of dow */
     UBYTE dst_start_dow;    /* 0=Sun, 1=Mon, ..., 6=Sat */
-    UBYTE dst_start_hour;   /* Local hour of transition */
+    UBYTE dst_start_hour;   /* Hour of transition, see dst_start_at */
     UBYTE dst_end_month;
     UBYTE dst_end_week;
     UBYTE dst_end_dow;
     UBYTE dst_end_hour;
+    UBYTE dst_start_at;     /* TZ_AT_* */
+    UBYTE dst_end_at;
+    UBYTE dst_start_min;    /* Minutes past dst_start_hour */
+    UBYTE dst_end_min;
+} TZRule;
+
+/* Timezone entry from generated tz_table.c. Strings live in the shared
+ * tz_strings[] pool; read them with tz_name(), tz_region(), tz_city(). */
+typedef struct {
+    UWORD name;             /* Pool offset of "America/Los_Angeles" */
+    UBYTE city;             /* Offset of "Los_Angeles" within the name */
+    UBYTE region;           /* Index into tz_regions[] / tz_region_names[] */
+    WORD  std_offset_mins;  /* Standard offset from UTC in minutes */
+    UBYTE rule;             /* Index into tz_rules[], 0 = no DST */
+    UBYTE pad;
 } TZEntry;
 
+/* Region index from generated tz_table.c: each region's zones are one
+ * contiguous run of tz_table[] */
+typedef struct {
+    UWORD first;            /* Index of the region's first tz_table entry */
+    UWORD count;            /* Number of entries in the region */
+} TZRegion;
+
 /* =========================================================================
  * config.c
  * ========================================================================= */
@@ -129,44 +271,186 @@ typedef struct {
 BOOL        config_init(void);
 void        config_cleanup(void);
 BOOL        config_load(void);
-BOOL        config_save(void);
+BOOL        config_save(void);   /* ENV: now if changed; ENVARC: deferred */
+BOOL        config_flush(void);  /* Write a deferred ENVARC: copy */
 SyncConfig *config_get(void);
 void        config_set_server(const char *server);
 void        config_set_interval(LONG interval);
 void        config_set_tz_name(const char *name);
+BOOL        config_load_state(ClockState *state);
+BOOL        config_save_state(const ClockState *state);
 
 /* =========================================================================
  * network.c
  * ========================================================================= */
 
 BOOL network_init(void);
+BOOL network_ready(void);
 void network_cleanup(void);
-BOOL network_resolve(const char *hostname, ULONG *ip_addr);
+LONG network_resolve_all(const char *hostname, ULONG *addrs, LONG max_addrs,
+                         BOOL *cached, ULONG *hold_secs);
+void network_mark_address(ULONG ip_addr, BOOL ok);
+ULONG network_kiss_address(ULONG ip_addr, UBYTE kiss, ULONG poll_secs);
+BOOL network_address_held(ULONG ip_addr);
+BOOL network_open_udp(void);
+void network_drain_udp(void);
+void network_close_udp(void);
+BOOL network_udp_is_open(void);
 BOOL network_send_udp(ULONG ip_addr, UWORD port,
-                      const UBYTE *data, ULONG len);
-LONG network_recv_udp(UBYTE *buf, ULONG buf_size, ULONG timeout_secs);
+                      const UBYTE *data, ULONG len, AmigaTime *sent_time);
+LONG network_recv_udp(UBYTE *buf, ULONG buf_size, ULONG timeout_ms,
+                      ULONG *from_ip, AmigaTime *recv_time);
+BOOL network_open_listen(BOOL *joined);
+void network_close_listen(void);
+BOOL network_listen_is_open(void);
+LONG network_recv_listen(UBYTE *buf, ULONG buf_size, ULONG *from_ip,
+                         UWORD *from_port, AmigaTime *recv_time);
+BOOL network_send_listen(ULONG ip_addr, UWORD port,
+                         const UBYTE *data, ULONG len);
+ULONG network_wait(ULONG sigmask, ULONG timeout_ms, BOOL *readable,
+                   BOOL *heard);
+
+/* =========================================================================
+ * listen.c - Broadcast/multicast client
+ * ========================================================================= */
+
+BOOL listen_start(void);
+void listen_stop(void);
+BOOL listen_active(void);
+BOOL listen_waiting(void);
+void listen_receive(void);
+BOOL listen_calibration_target(ULONG *ip_addr);
+void listen_synced(ULONG ip_addr, LONG delay_micro);
+LONG listen_apply(void);
+
+/* =========================================================================
+ * serve.c - LAN SNTP server
+ * ========================================================================= */
+
+void serve_synced(ULONG ip_addr, UBYTE stratum, LONG delay_micro,
+                  const AmigaTime *when);
+void serve_request(const UBYTE *packet, ULONG from_ip, UWORD from_port,
+                   const AmigaTime *t2);
+
+/* =========================================================================
+ * sync.c - Incremental sync state machine
+ * ========================================================================= */
+
+BOOL  sync_start(void);
+BOOL  sync_start_address(ULONG ip_addr);
+LONG  sync_apply_sample(ULONG ip_addr, const SNTPSample *sample);
+void  sync_abort(void);
+BOOL  sync_busy(void);
+BOOL  sync_awaiting(void);
+ULONG sync_wait_timeout(void);
+LONG  sync_step(BOOL readable);  /* Returns STATUS_SYNCING until finished */
+const char      *sync_result_text(void);
+ULONG            sync_hold_secs(void);
+ULONG            sync_result_addr(void);
+LONG             sync_result_delay(void);
+UBYTE            sync_result_stratum(void);
+const AmigaTime *sync_result_time(void);
+
+/* =========================================================================
+ * drift.c - Clock drift estimation and adaptive poll interval
+ * ========================================================================= */
+
+void  drift_reset(void);
+void  drift_update(const ClockOffset *offset, const AmigaTime *now);
+void  drift_clock_shifted(LONG secs);
+ULONG drift_poll_interval(void);
+BOOL  drift_freq_ppb(LONG *ppb);
+void  drift_restore(void);
+void  drift_persist(void);
+void  drift_cleanup(void);
+
+/* =========================================================================
+ * dst.c - DST transitions between syncs
+ * ========================================================================= */
+
+void dst_schedule(void);
+void dst_cancel(void);
+LONG dst_handle(void);   /* Call when clock_alarm_signal() fires */
+
+/* =========================================================================
+ * stats.c - Sync statistics (window summary and ENV:SyncTimeStats)
+ * ========================================================================= */
+
+void stats_record_dns(ULONG ms);
+void stats_record_sample(LONG offset_micro, LONG delay_micro);
+void stats_record_result(BOOL ok);
+void stats_format(char *buf);  /* buf holds at least 64 bytes */
+void stats_export(void);
+
+/* =========================================================================
+ * log.c - Levelled log sink (window or console, and optional file)
+ * ========================================================================= */
+
+BOOL log_enabled(LONG level);
+void log_msg(LONG level, const char *text);
+void log_set_console(BOOL on);
+void log_flush(void);
+void log_cleanup(void);
 
 /* =========================================================================
  * sntp.c
  * ========================================================================= */
 
-void sntp_build_request(UBYTE *packet);
-BOOL sntp_parse_response(const UBYTE *packet, ULONG *ntp_secs,
-                         ULONG *ntp_frac);
+void  sntp_build_request(UBYTE *packet, const AmigaTime *t1);
+BOOL  sntp_parse_response(const UBYTE *packet, SNTPResponse *resp);
+BOOL  sntp_build_reply(UBYTE *reply, const UBYTE *request,
+                       const SNTPServerInfo *info, const TZEntry *tz,
+                       const AmigaTime *t2, const AmigaTime *t3);
+UBYTE sntp_parse_kiss(const UBYTE *packet, SNTPResponse *resp);
+BOOL  sntp_matches_request(const SNTPResponse *resp, const AmigaTime *t1);
+ULONG sntp_poll_secs(const SNTPResponse *resp);
+BOOL  sntp_compute_sample(const SNTPResponse *resp, const AmigaTime *t1,
+                          const AmigaTime *sent, const AmigaTime *t4,
+                          const TZEntry *tz, SNTPSample *sample);
+void  sntp_compute_broadcast(const SNTPResponse *resp, const AmigaTime *t4,
+                             LONG one_way_micro, const TZEntry *tz,
+                             SNTPSample *sample);
+LONG  sntp_offset_to_micro(const ClockOffset *offset);
+LONG  sntp_filter_samples(const SNTPSample *samples, LONG count,
+                          SNTPSample *best);
 ULONG sntp_ntp_to_amiga(ULONG ntp_secs, const TZEntry *tz);
+ULONG sntp_amiga_to_ntp(ULONG amiga_secs, const TZEntry *tz);
+
+/* =========================================================================
+ * calendar.c - Civil date arithmetic (Amiga day numbers, 1978 = day 0)
+ * ========================================================================= */
+
+BOOL  cal_is_leap_year(LONG year);
+UBYTE cal_days_in_month(LONG year, UBYTE month);
+ULONG cal_days_from_civil(LONG year, UBYTE month, UBYTE day);
+void  cal_civil_from_days(ULONG days, LONG *year, UBYTE *month, UBYTE *day);
+UBYTE cal_day_of_week(ULONG days);
 
 /* =========================================================================
  * tz.c - Timezone database functions
  * ========================================================================= */
 
+extern const char tz_strings[];
+extern const TZRule tz_rules[];
+extern const ULONG tz_rule_count;
 extern const TZEntry tz_table[];
 extern const ULONG tz_table_count;
-
+extern const TZRegion tz_regions[];
+extern const char *const tz_region_names[];
+extern const ULONG tz_region_count;
+
+void           tz_init(void);
+void           tz_cleanup(void);
+const char    *tz_name(const TZEntry *tz);
+const char    *tz_region(const TZEntry *tz);
+const char    *tz_city(const TZEntry *tz);
+const TZRule  *tz_rule(const TZEntry *tz);
 const TZEntry *tz_find_by_name(const char *name);
-const char   **tz_get_regions(ULONG *count);
-const TZEntry **tz_get_cities_for_region(const char *region, ULONG *count);
+const char *const *tz_get_regions(ULONG *count);
+const TZEntry  *tz_get_cities_for_region(const char *region, ULONG *count);
 BOOL           tz_is_dst_active(const TZEntry *tz, ULONG utc_secs);
 LONG           tz_get_offset_mins(const TZEntry *tz, ULONG utc_secs);
+ULONG          tz_next_transition(const TZEntry *tz, ULONG utc_secs);
 BOOL           tz_set_env(const TZEntry *tz);
 
 /* =========================================================================
@@ -177,7 +461,26 @@ BOOL clock_init(void);
 void clock_cleanup(void);
 BOOL clock_set_system_time(ULONG amiga_secs, ULONG amiga_micro);
 BOOL clock_get_system_time(ULONG *amiga_secs, ULONG *amiga_micro);
+BOOL clock_get_precise_time(AmigaTime *t);  /* EClock resolution */
+BOOL clock_adjust_system_time(const ClockOffset *offset, AmigaTime *new_time);
 void clock_format_time(ULONG amiga_secs, char *buf, ULONG buf_size);
+BOOL clock_read_battclock(ULONG *amiga_secs);
+BOOL clock_write_battclock(ULONG amiga_secs);
+
+/* Gradual correction (slewing) instead of stepping the clock */
+BOOL  clock_slew_start(LONG offset_micro);
+void  clock_slew_stop(void);
+LONG  clock_slew_remaining(void);
+ULONG clock_slew_signal(void);
+void  clock_handle_slew(void);   /* Call when clock_slew_signal() fires */
+BOOL  clock_set_drift(LONG ppb);
+LONG  clock_take_drift_applied(void);
+
+/* Alarm at a given system time, for DST transitions */
+BOOL  clock_start_alarm(ULONG amiga_secs);
+void  clock_abort_alarm(void);
+ULONG clock_alarm_signal(void);
+BOOL  clock_check_alarm(void);
 
 /* Timer for periodic sync */
 BOOL  clock_start_timer(ULONG seconds);
@@ -191,10 +494,13 @@ BOOL  clock_check_timer(void);  /* Check if timer fired and acknowledge it */
 
 BOOL  window_open(struct Screen *screen);
 void  window_close(void);
+void  window_expire(void);   /* Close GUI libraries if hidden long enough */
+void  window_cleanup(void);  /* Close window and GUI libraries */
 BOOL  window_is_open(void);
 BOOL  window_handle_events(SyncConfig *cfg, SyncStatus *st);  /* Returns TRUE if "Sync Now" requested */
 ULONG window_signal(void);
-void  window_update_status(SyncStatus *st);
+void  window_update_status(SyncStatus *st);  /* Queued until window_refresh() */
+void  window_refresh(void);  /* Apply changed display texts to the gadgets */
 void  window_log(const char *message);  /* Add entry to scrollable log */
 
 /* =========================================================================
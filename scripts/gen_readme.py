@@ -107,6 +107,10 @@ def generate_readme(readme_path, version):
         output.append(format_section('Tooltypes', sections['tooltypes']))
         output.append('')
 
+    if 'preferences' in sections:
+        output.append(format_section('Preferences', sections['preferences']))
+        output.append('')
+
     if 'requirements' in sections:
         output.append(format_section('Requirements', sections['requirements']))
         output.append('')
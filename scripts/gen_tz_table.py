@@ -7,6 +7,11 @@ timezone offsets and DST transition rules, outputting tz_table.c for
 compilation into SyncTime.
 
 Usage: python3 scripts/gen_tz_table.py tzdata-dir > src/tz_table.c
+       python3 scripts/gen_tz_table.py --binary SyncTime.tz tzdata-dir
+
+The second form writes the optional SyncTime.tz data file instead, which
+SyncTime reads from PROGDIR: or ENVARC: in preference to the built-in
+table, so a tzdb update doesn't need a rebuild.
 
 Zone format example:
     Zone America/Los_Angeles -7:52:58 -  LMT    1883 Nov 18 20:00u
@@ -30,6 +35,7 @@ ON field formats:
 import sys
 import os
 import re
+import struct
 from dataclasses import dataclass, field
 from datetime import date
 from typing import Dict, List, Optional, Tuple
@@ -52,6 +58,15 @@ MONTHS = {
     'Jul': 7, 'Aug': 8, 'Sep': 9, 'Oct': 10, 'Nov': 11, 'Dec': 12
 }
 
+# AT suffixes: what the transition hour is measured in (TZ_AT_* in
+# synctime.h). No suffix or 'w' is wall clock time, 's' local standard
+# time, 'u' (or 'g', 'z') UTC.
+AT_WALL = 0
+AT_STD = 1
+AT_UTC = 2
+
+AT_SUFFIXES = {'w': AT_WALL, 's': AT_STD, 'u': AT_UTC, 'g': AT_UTC, 'z': AT_UTC}
+
 # Day of week mapping
 DAYS = {
     'Sun': 0, 'Mon': 1, 'Tue': 2, 'Wed': 3,
@@ -66,7 +81,9 @@ class DSTRule:
     week: int = 0         # 1-5, 5=last
     dow: int = 0          # 0=Sun, 6=Sat
     hour: int = 0         # Hour of transition
+    at: int = AT_WALL     # What the hour is measured in
     offset_mins: int = 0  # Offset to add during this period
+    minute: int = 0       # Minutes past the hour
 
 
 @dataclass
@@ -93,6 +110,10 @@ class TZEntry:
     dst_end_week: int = 0
     dst_end_dow: int = 0
     dst_end_hour: int = 0
+    dst_start_at: int = AT_WALL
+    dst_end_at: int = AT_WALL
+    dst_start_min: int = 0
+    dst_end_min: int = 0
 
 
 def parse_offset(offset_str: str) -> int:
@@ -123,19 +144,22 @@ def parse_offset(offset_str: str) -> int:
     return -total_mins if negative else total_mins
 
 
-def parse_time(time_str: str) -> int:
-    """Parse a time string into hours (ignoring suffix like u, s, w).
+def parse_time(time_str: str) -> Tuple[int, int, int]:
+    """Parse an AT time string into (hours, minutes, AT_* suffix).
 
     Examples:
-        '2:00' -> 2
-        '1:00u' -> 1
-        '23:00s' -> 23
+        '2:00' -> (2, 0, AT_WALL)
+        '1:00u' -> (1, 0, AT_UTC)
+        '2:45s' -> (2, 45, AT_STD)
     """
-    # Remove suffix (u=UTC, s=standard, w=wall)
-    time_str = time_str.rstrip('usw')
+    at = AT_WALL
+    if time_str and time_str[-1] in AT_SUFFIXES:
+        at = AT_SUFFIXES[time_str[-1]]
+        time_str = time_str[:-1]
 
     parts = time_str.split(':')
-    return int(parts[0])
+    minutes = int(parts[1]) if len(parts) > 1 else 0
+    return int(parts[0]), minutes, at
 
 
 def parse_on_field(on_str: str) -> Tuple[int, int]:
@@ -250,7 +274,7 @@ def parse_rules(tzdb_dir: str) -> Dict[str, RuleSet]:
                 # Parse rule details
                 month = MONTHS.get(month_str, 1)
                 week, dow = parse_on_field(on_str)
-                hour = parse_time(at_str)
+                hour, minute, at = parse_time(at_str)
                 offset_mins = parse_save_field(save_str)
 
                 rule = DSTRule(
@@ -258,7 +282,9 @@ def parse_rules(tzdb_dir: str) -> Dict[str, RuleSet]:
                     week=week,
                     dow=dow,
                     hour=hour,
-                    offset_mins=offset_mins
+                    at=at,
+                    offset_mins=offset_mins,
+                    minute=minute
                 )
 
                 if name not in rules:
@@ -273,19 +299,35 @@ def get_current_rules(ruleset: RuleSet) -> Tuple[Optional[DSTRule], Optional[DST
 
     Returns (start_rule, end_rule) for the current year and beyond.
     A rule is 'current' if to_year == 9999 (max).
-    Start rule has offset > 0, end rule has offset == 0.
+    Start rule has offset > 0, end rule has offset == 0. A ruleset with
+    negative SAVE (Eire: summer is standard time, winter saves -1:00)
+    is turned around: the negative rule ends DST and the one with SAVE
+    0 starts it, with create_tz_entry() moving the standard offset.
     """
     current_year = date.today().year
 
     start_rule = None
     end_rule = None
 
-    for from_yr, to_yr, rule in ruleset.rules:
-        if to_yr >= current_year and from_yr <= current_year:
-            if rule.offset_mins > 0:
-                start_rule = rule
-            else:
+    current = [rule for from_yr, to_yr, rule in ruleset.rules
+               if to_yr >= current_year and from_yr <= current_year]
+
+    if any(rule.offset_mins < 0 for rule in current):
+        for rule in current:
+            if rule.offset_mins < 0:
                 end_rule = rule
+            elif rule.offset_mins == 0:
+                start_rule = DSTRule(rule.month, rule.week, rule.dow,
+                                     rule.hour, rule.at, 0, rule.minute)
+        if start_rule and end_rule:
+            start_rule.offset_mins = -end_rule.offset_mins
+        return start_rule, end_rule
+
+    for rule in current:
+        if rule.offset_mins > 0:
+            start_rule = rule
+        else:
+            end_rule = rule
 
     return start_rule, end_rule
 
@@ -382,6 +424,9 @@ def create_tz_entry(zone_name: str, std_offset: int, rule_name: Optional[str],
         start_rule, end_rule = get_current_rules(ruleset)
 
         if start_rule and end_rule:
+            if end_rule.offset_mins < 0:
+                # Negative DST: winter is the zone's standard time here
+                entry.std_offset_mins += end_rule.offset_mins
             entry.dst_offset_mins = start_rule.offset_mins
             entry.dst_start_month = start_rule.month
             entry.dst_start_week = start_rule.week
@@ -391,14 +436,140 @@ def create_tz_entry(zone_name: str, std_offset: int, rule_name: Optional[str],
             entry.dst_end_week = end_rule.week
             entry.dst_end_dow = end_rule.dow
             entry.dst_end_hour = end_rule.hour
+            entry.dst_start_at = start_rule.at
+            entry.dst_end_at = end_rule.at
+            entry.dst_start_min = start_rule.minute
+            entry.dst_end_min = end_rule.minute
 
     return entry
 
 
+def c_string(text: str) -> str:
+    """Escape text for use inside a C string literal."""
+    return text.replace('\\', '\\\\').replace('"', '\\"')
+
+
+@dataclass
+class Tables:
+    """The packed tables shared by the C and binary outputs."""
+    zones: List[TZEntry]
+    regions: List[Tuple[str, int, int]]   # (name, first, count)
+    region_index: Dict[str, int]
+    pool: List[str]
+    offsets: Dict[str, int]
+    pool_size: int
+    rules: List[Tuple[int, ...]]
+    zone_rules: List[int]
+
+
+def build_tables(zones: List[TZEntry]) -> Tables:
+    """Sort, group and pack the zones.
+
+    Layout, to keep the resident table small on 1-2 MB machines:
+      strings  one pool of NUL-terminated strings: region names,
+               then full zone names (cities are suffixes of those)
+      rules    each distinct DST rule once; entry 0 is "no DST"
+      zones    8-byte entries with 16-bit pool offsets and indexes
+      regions  one contiguous [first, count] slice per region
+    """
+    # Sort zones by name in byte order, which is what strcmp() uses:
+    # tz_find_by_name() binary-searches the table and relies on it
+    zones.sort(key=lambda z: z.name.encode('utf-8'))
+    for prev, cur in zip(zones, zones[1:]):
+        if prev.name == cur.name:
+            raise ValueError(f"duplicate zone name: {cur.name}")
+
+    # Group by region. Names sort as "Region/City", so each region's
+    # zones already form one contiguous run of the table.
+    regions: List[Tuple[str, int, int]] = []
+    for index, zone in enumerate(zones):
+        if regions and regions[-1][0] == zone.region:
+            name, first, count = regions[-1]
+            regions[-1] = (name, first, count + 1)
+        else:
+            if any(r[0] == zone.region for r in regions):
+                raise ValueError(f"region not contiguous: {zone.region}")
+            regions.append((zone.region, index, 1))
+
+    keys = [r[0].encode('utf-8') for r in regions]
+    if keys != sorted(keys):
+        raise ValueError("regions not in strcmp() order")
+    region_index = {r[0]: i for i, r in enumerate(regions)}
+
+    # String pool
+    pool: List[str] = []
+    offsets: Dict[str, int] = {}
+    size = 0
+    for text in [r[0] for r in regions] + [z.name for z in zones]:
+        offsets[text] = size
+        pool.append(text)
+        size += len(text.encode('utf-8')) + 1
+    if size > 0xFFFF:
+        raise ValueError("string pool exceeds 16-bit offsets")
+
+    # Rule table, deduplicated; index 0 means no DST
+    no_dst = (0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)
+    rules: List[Tuple[int, ...]] = [no_dst]
+    rule_index: Dict[Tuple[int, ...], int] = {no_dst: 0}
+    zone_rules: List[int] = []
+    for zone in zones:
+        rule = (zone.dst_offset_mins,
+                zone.dst_start_month, zone.dst_start_week,
+                zone.dst_start_dow, zone.dst_start_hour,
+                zone.dst_end_month, zone.dst_end_week,
+                zone.dst_end_dow, zone.dst_end_hour,
+                zone.dst_start_at, zone.dst_end_at,
+                zone.dst_start_min, zone.dst_end_min)
+        if rule not in rule_index:
+            rule_index[rule] = len(rules)
+            rules.append(rule)
+        zone_rules.append(rule_index[rule])
+    if len(rules) > 256 or len(regions) > 256:
+        raise ValueError("too many rules or regions for 8-bit indexes")
+
+    for zone in zones:
+        if len(zone.name.encode('utf-8')) - len(zone.city.encode('utf-8')) > 255:
+            raise ValueError(f"region too long: {zone.name}")
+
+    return Tables(zones, regions, region_index, pool, offsets, size,
+                  rules, zone_rules)
+
+
+def generate_binary_output(zones: List[TZEntry]) -> bytes:
+    """Generate the SyncTime.tz data file read by tz.c.
+
+    Big-endian; the same tables as tz_table.c:
+      header   "STTZ", UWORD version, pool size, rule, zone and region
+               counts, reserved
+      regions  UWORD first, count, name offset
+      rules    WORD dst_offset_mins, 12 x UBYTE
+      zones    UWORD name, UBYTE city, UBYTE region, WORD std_offset_mins,
+               UBYTE rule, UBYTE pad
+      strings  the pool
+    """
+    t = build_tables(zones)
+    out = bytearray(b'STTZ')
+    out += struct.pack('>HHHHHH', 2, t.pool_size, len(t.rules),
+                       len(t.zones), len(t.regions), 0)
+    for name, first, count in t.regions:
+        out += struct.pack('>HHH', first, count, t.offsets[name])
+    for rule in t.rules:
+        out += struct.pack('>h12B', *rule)
+    for zone, rule in zip(t.zones, t.zone_rules):
+        city_pos = len(zone.name.encode('utf-8')) - len(zone.city.encode('utf-8'))
+        out += struct.pack('>HBBhBB', t.offsets[zone.name], city_pos,
+                           t.region_index[zone.region], zone.std_offset_mins,
+                           rule, 0)
+    for text in t.pool:
+        out += text.encode('utf-8') + b'\0'
+    return bytes(out)
+
+
 def generate_c_output(zones: List[TZEntry]) -> str:
     """Generate the C source file content."""
-    # Sort zones by name
-    zones.sort(key=lambda z: z.name)
+    t = build_tables(zones)
+    zones, regions, region_index = t.zones, t.regions, t.region_index
+    pool, offsets, rules, zone_rules = t.pool, t.offsets, t.rules, t.zone_rules
 
     lines = []
     lines.append('/* tz_table.c - Generated timezone table from IANA tzdb */')
@@ -406,41 +577,71 @@ def generate_c_output(zones: List[TZEntry]) -> str:
     lines.append('')
     lines.append('#include "synctime.h"')
     lines.append('')
+    lines.append('/* Shared string pool: region names, then zone names */')
+    lines.append('const char tz_strings[] =')
+    for text in pool:
+        literal = f'    "{c_string(text)}\\0"'
+        lines.append(f'{literal:<40}/* {offsets[text]} */')
+    lines.append('    ;')
+    lines.append('')
+    lines.append('/* Distinct DST rules; 0 = no DST */')
+    lines.append('const TZRule tz_rules[] = {')
+    for rule in rules:
+        lines.append('    {' + ', '.join(str(v) for v in rule) + '},')
+    lines.append('};')
+    lines.append('')
+    lines.append(f'const ULONG tz_rule_count = {len(rules)};')
+    lines.append('')
+    lines.append('/* Sorted by name in strcmp() order for tz_find_by_name() */')
     lines.append('const TZEntry tz_table[] = {')
-
-    for zone in zones:
-        # Escape any special characters in strings
-        name = zone.name.replace('\\', '\\\\').replace('"', '\\"')
-        region = zone.region.replace('\\', '\\\\').replace('"', '\\"')
-        city = zone.city.replace('\\', '\\\\').replace('"', '\\"')
-
-        line = f'    {{"{name}", "{region}", "{city}", '
-        line += f'{zone.std_offset_mins}, {zone.dst_offset_mins}, '
-        line += f'{zone.dst_start_month}, {zone.dst_start_week}, '
-        line += f'{zone.dst_start_dow}, {zone.dst_start_hour}, '
-        line += f'{zone.dst_end_month}, {zone.dst_end_week}, '
-        line += f'{zone.dst_end_dow}, {zone.dst_end_hour}}},'
-        lines.append(line)
-
+    for zone, rule in zip(zones, zone_rules):
+        city_pos = len(zone.name.encode('utf-8')) - len(zone.city.encode('utf-8'))
+        line = f'    {{{offsets[zone.name]}, {city_pos}, '
+        line += f'{region_index[zone.region]}, {zone.std_offset_mins}, '
+        line += f'{rule}, 0}},'
+        lines.append(f'{line:<40}/* {zone.name} */')
     lines.append('};')
     lines.append('')
     lines.append(f'const ULONG tz_table_count = {len(zones)};')
     lines.append('')
+    lines.append('/* One contiguous slice of tz_table per region, in table order */')
+    lines.append('const TZRegion tz_regions[] = {')
+    for name, first, count in regions:
+        line = f'    {{{first}, {count}}},'
+        lines.append(f'{line:<40}/* {name} */')
+    lines.append('};')
+    lines.append('')
+    lines.append('/* Region names, NULL-terminated for chooser labels */')
+    lines.append('const char *const tz_region_names[] = {')
+    for name, first, count in regions:
+        lines.append(f'    tz_strings + {offsets[name]},')
+    lines.append('    NULL')
+    lines.append('};')
+    lines.append('')
+    lines.append(f'const ULONG tz_region_count = {len(regions)};')
+    lines.append('')
 
     return '\n'.join(lines)
 
 
 def main():
     """Main entry point."""
-    if len(sys.argv) < 2:
-        print(f"Usage: {sys.argv[0]} <tzdb-directory>", file=sys.stderr)
+    args = sys.argv[1:]
+    binary_path = None
+    if len(args) >= 2 and args[0] == '--binary':
+        binary_path = args[1]
+        args = args[2:]
+
+    if len(args) < 1:
+        print(f"Usage: {sys.argv[0]} [--binary <file>] <tzdb-directory>", file=sys.stderr)
         print("", file=sys.stderr)
-        print("Parses IANA tzdb source files and generates tz_table.c", file=sys.stderr)
+        print("Parses IANA tzdb source files and generates tz_table.c,", file=sys.stderr)
+        print("or with --binary the SyncTime.tz data file", file=sys.stderr)
         print("", file=sys.stderr)
         print("Example: python3 scripts/gen_tz_table.py tzdb-2025c > src/tz_table.c", file=sys.stderr)
         sys.exit(1)
 
-    tzdb_dir = sys.argv[1]
+    tzdb_dir = args[0]
 
     if not os.path.isdir(tzdb_dir):
         print(f"Error: '{tzdb_dir}' is not a directory", file=sys.stderr)
@@ -461,10 +662,16 @@ def main():
     print(f"After filtering: {len(zones)} zones", file=sys.stderr)
 
     # Generate output
-    output = generate_c_output(zones)
-    print(output)
-
-    print(f"Generated tz_table.c with {len(zones)} entries", file=sys.stderr)
+    if binary_path:
+        data = generate_binary_output(zones)
+        with open(binary_path, 'wb') as f:
+            f.write(data)
+        print(f"Generated {binary_path} with {len(zones)} entries, "
+              f"{len(data)} bytes", file=sys.stderr)
+    else:
+        output = generate_c_output(zones)
+        print(output)
+        print(f"Generated tz_table.c with {len(zones)} entries", file=sys.stderr)
 
 
 if __name__ == '__main__':
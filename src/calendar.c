@@ -0,0 +1,112 @@
+/* calendar.c - Civil date arithmetic for SyncTime
+ *
+ * Constant-time conversion between Amiga day numbers (days since
+ * Jan 1, 1978) and Gregorian year/month/day, after Howard Hinnant's
+ * days_from_civil / civil_from_days. The year is shifted to start in
+ * March so the leap day falls at its end, which turns the month
+ * lengths into a linear formula; 400-year eras then make the leap
+ * rules plain division. No loops, and every intermediate fits in a
+ * LONG for any date an Amiga clock can hold.
+ */
+
+#include "synctime.h"
+
+/* Days from 0000-03-01 (era-based day 0) to 1978-01-01 */
+#define AMIGA_EPOCH_DAYS  722390L
+
+/* Days in a 400-year Gregorian era */
+#define DAYS_PER_ERA      146097L
+
+/* Days in each month (non-leap year) */
+static const UBYTE days_in_month[12] = {
+    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+/* =========================================================================
+ * cal_is_leap_year - Gregorian leap year rule
+ * ========================================================================= */
+
+BOOL cal_is_leap_year(LONG year)
+{
+    if ((year % 4) != 0)
+        return FALSE;
+    if ((year % 100) != 0)
+        return TRUE;
+    return (year % 400) == 0;
+}
+
+/* =========================================================================
+ * cal_days_in_month - Days in a month (1-12), accounting for leap years
+ *
+ * Returns 0 for an invalid month.
+ * ========================================================================= */
+
+UBYTE cal_days_in_month(LONG year, UBYTE month)
+{
+    if (month < 1 || month > 12)
+        return 0;
+    if (month == 2 && cal_is_leap_year(year))
+        return 29;
+    return days_in_month[month - 1];
+}
+
+/* =========================================================================
+ * cal_days_from_civil - Amiga day number of a Gregorian date
+ *
+ * year must be 1978 or later; month 1-12, day 1-31.
+ * ========================================================================= */
+
+ULONG cal_days_from_civil(LONG year, UBYTE month, UBYTE day)
+{
+    LONG era, yoe, doy, doe;
+
+    /* Count years from March, so January and February belong to the
+     * previous year */
+    if (month <= 2)
+        year--;
+
+    era = year / 400;
+    yoe = year - era * 400;                                /* 0..399 */
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;           /* 0..146096 */
+
+    return (ULONG)(era * DAYS_PER_ERA + doe - AMIGA_EPOCH_DAYS);
+}
+
+/* =========================================================================
+ * cal_civil_from_days - Gregorian date of an Amiga day number
+ *
+ * Any of year, month, day may be NULL.
+ * ========================================================================= */
+
+void cal_civil_from_days(ULONG days, LONG *year, UBYTE *month, UBYTE *day)
+{
+    LONG z, era, doe, yoe, doy, mp, y, m;
+
+    z   = (LONG)days + AMIGA_EPOCH_DAYS;
+    era = z / DAYS_PER_ERA;
+    doe = z - era * DAYS_PER_ERA;                          /* 0..146096 */
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);         /* 0..365 */
+    mp  = (5 * doy + 2) / 153;                             /* 0 = March */
+    m   = mp < 10 ? mp + 3 : mp - 9;
+    y   = yoe + era * 400 + (m <= 2 ? 1 : 0);
+
+    if (year)
+        *year = y;
+    if (month)
+        *month = (UBYTE)m;
+    if (day)
+        *day = (UBYTE)(doy - (153 * mp + 2) / 5 + 1);
+}
+
+/* =========================================================================
+ * cal_day_of_week - Day of week of an Amiga day number
+ *
+ * Returns 0=Sunday, 1=Monday, ... 6=Saturday. Jan 1, 1978 was a Sunday.
+ * ========================================================================= */
+
+UBYTE cal_day_of_week(ULONG days)
+{
+    return (UBYTE)(days % 7);
+}
@@ -17,8 +17,62 @@ static struct timerequest *periodic_treq = NULL;
 /* Tracks whether an asynchronous timer request is outstanding */
 static BOOL timer_pending = FALSE;
 
+/* Slew timerequest: separate UNIT_MICROHZ opening that paces the small
+ * adjustments of a slewed correction */
+static struct MsgPort     *slew_port     = NULL;
+static struct timerequest *slew_treq     = NULL;
+static BOOL slew_pending   = FALSE;
+static LONG slew_remaining = 0;     /* Correction still to apply, microseconds */
+
+/* Alarm timerequest: UNIT_WAITUNTIL opening that fires when the system
+ * clock reaches a given time, for DST transitions (dst.c) */
+static struct MsgPort     *alarm_port    = NULL;
+static struct timerequest *alarm_treq    = NULL;
+static BOOL alarm_pending  = FALSE;
+
+/* Slew pacing: at most SLEW_STEP_MICRO per SLEW_PERIOD_MICRO, i.e. the
+ * clock runs at most 1% fast or slow. AmigaOS can only set the clock,
+ * so a slow-down is a small step back; it is held to the 1/50 s tick
+ * (CLOCK_TICK_MICRO) already running and to the last time read or set
+ * here, so DateStamp ticks and our own readings never go backwards.
+ * Whatever doesn't fit is left for the next adjustment. A TR_GETSYSTIME
+ * reading by another program within the same tick can still repeat. */
+#define SLEW_PERIOD_MICRO  250000
+#define SLEW_STEP_MICRO    2500
+#define CLOCK_TICK_MICRO   20000
+
+/* Drift compensation rides on the slew timer. Tick lengths are counted
+ * in quarter seconds; between corrections the timer is paced so each
+ * drift adjustment stays within SLEW_STEP_MICRO, but at most one minute. */
+#define DRIFT_MAX_QUARTERS 240
+
+#define DRIFT_MAX_OWED     1000000000L  /* ns; a clock that can't be set */
+
+static LONG slew_quarters  = 1;     /* Length of the queued tick */
+static LONG drift_ppb      = 0;     /* Compensation rate, ns per second */
+static LONG drift_nanos    = 0;     /* Sub-microsecond drift carried over */
+static LONG drift_applied  = 0;     /* Microseconds applied, see clock_take_drift_applied */
+
+/* High-resolution time: the system time at one EClock reading, moved
+ * forward by the EClock count since. The anchor is exact whenever we
+ * set the clock ourselves; otherwise it comes from TR_GETSYSTIME and
+ * is compared against it every CLOCK_CHECK_SECS in case someone else
+ * set the clock. */
+#define CLOCK_CHECK_SECS   60
+#define CLOCK_CHECK_MICRO  100000
+
+static BOOL             anchor_valid   = FALSE;
+static AmigaTime        anchor_time;
+static struct EClockVal anchor_eclock;
+static ULONG            anchor_checked = 0;  /* Elapsed secs at last check */
+static ULONG            eclock_freq    = 0;   /* Ticks per second */
+static AmigaTime        last_time;            /* Last time read or set */
+
 /* --------------------------------------------------------------------------
- * clock_init - Open timer.device and set up both timerequests
+ * clock_init - Open timer.device and set up its timerequests
+ *
+ * The main (UNIT_VBLANK) and periodic requests are required; the slew
+ * (UNIT_MICROHZ) and alarm (UNIT_WAITUNTIL) requests are optional.
  * -------------------------------------------------------------------------- */
 
 BOOL clock_init(void)
@@ -45,8 +99,13 @@ BOOL clock_init(void)
         goto fail;
     }
 
-    /* 4. Set TimerBase so proto/timer.h functions work */
+    /* 4. Set TimerBase so proto/timer.h functions work (ReadEClock()
+     * works with any unit, so no UNIT_ECLOCK opening is needed) */
     TimerBase = (struct Device *)main_treq->tr_node.io_Device;
+    anchor_valid = FALSE;
+
+    /* 4b. battclock.resource, if the machine has a battery clock */
+    BattClockBase = OpenResource(BATTCLOCKNAME);
 
     /* 5. Create periodic message port */
     periodic_port = CreateMsgPort();
@@ -63,6 +122,40 @@ BOOL clock_init(void)
     periodic_treq->tr_node.io_Device = main_treq->tr_node.io_Device;
     periodic_treq->tr_node.io_Unit   = main_treq->tr_node.io_Unit;
 
+    /* 8. Slew timer on UNIT_MICROHZ for sub-tick pacing. Optional: if
+     * it can't be set up, corrections are always applied as steps. */
+    slew_port = CreateMsgPort();
+    if (slew_port) {
+        slew_treq = (struct timerequest *)
+            CreateIORequest(slew_port, sizeof(struct timerequest));
+        if (slew_treq && OpenDevice("timer.device", UNIT_MICROHZ,
+                                    (struct IORequest *)slew_treq, 0) != 0) {
+            DeleteIORequest((struct IORequest *)slew_treq);
+            slew_treq = NULL;
+        }
+        if (!slew_treq) {
+            DeleteMsgPort(slew_port);
+            slew_port = NULL;
+        }
+    }
+
+    /* 9. Alarm on UNIT_WAITUNTIL. Optional as well: without it DST
+     * changes wait for the next sync. */
+    alarm_port = CreateMsgPort();
+    if (alarm_port) {
+        alarm_treq = (struct timerequest *)
+            CreateIORequest(alarm_port, sizeof(struct timerequest));
+        if (alarm_treq && OpenDevice("timer.device", UNIT_WAITUNTIL,
+                                     (struct IORequest *)alarm_treq, 0) != 0) {
+            DeleteIORequest((struct IORequest *)alarm_treq);
+            alarm_treq = NULL;
+        }
+        if (!alarm_treq) {
+            DeleteMsgPort(alarm_port);
+            alarm_port = NULL;
+        }
+    }
+
     return TRUE;
 
 fail:
@@ -76,6 +169,31 @@ fail:
 
 void clock_cleanup(void)
 {
+    /* 0. Stop slewing and release the UNIT_MICROHZ opening */
+    drift_ppb = 0;
+    clock_slew_stop();
+    if (slew_treq) {
+        CloseDevice((struct IORequest *)slew_treq);
+        DeleteIORequest((struct IORequest *)slew_treq);
+        slew_treq = NULL;
+    }
+    if (slew_port) {
+        DeleteMsgPort(slew_port);
+        slew_port = NULL;
+    }
+
+    /* 0b. Release the UNIT_WAITUNTIL opening */
+    clock_abort_alarm();
+    if (alarm_treq) {
+        CloseDevice((struct IORequest *)alarm_treq);
+        DeleteIORequest((struct IORequest *)alarm_treq);
+        alarm_treq = NULL;
+    }
+    if (alarm_port) {
+        DeleteMsgPort(alarm_port);
+        alarm_port = NULL;
+    }
+
     /* 1. If a timer is pending, abort and wait for it */
     if (timer_pending && periodic_treq) {
         AbortIO((struct IORequest *)periodic_treq);
@@ -109,8 +227,22 @@ void clock_cleanup(void)
         main_port = NULL;
     }
 
-    /* 5. Clear TimerBase */
+    /* 5. Clear TimerBase (resources are never closed) */
     TimerBase = NULL;
+    BattClockBase = NULL;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: anchor the high-resolution time at a known system time
+ * -------------------------------------------------------------------------- */
+
+static void set_anchor(ULONG secs, ULONG micro, const struct EClockVal *ev)
+{
+    anchor_time.secs  = secs;
+    anchor_time.micro = micro;
+    anchor_eclock     = *ev;
+    anchor_checked    = 0;
+    anchor_valid      = TRUE;
 }
 
 /* --------------------------------------------------------------------------
@@ -119,6 +251,8 @@ void clock_cleanup(void)
 
 BOOL clock_set_system_time(ULONG amiga_secs, ULONG amiga_micro)
 {
+    struct EClockVal ev;
+
     if (!main_treq)
         return FALSE;
 
@@ -126,9 +260,16 @@ BOOL clock_set_system_time(ULONG amiga_secs, ULONG amiga_micro)
     main_treq->tr_time.tv_secs    = amiga_secs;
     main_treq->tr_time.tv_micro   = amiga_micro;
 
+    eclock_freq = ReadEClock(&ev);
     DoIO((struct IORequest *)main_treq);
 
-    return (main_treq->tr_node.io_Error == 0) ? TRUE : FALSE;
+    if (main_treq->tr_node.io_Error != 0)
+        return FALSE;
+
+    /* The clock now reads exactly this; anchor the precise time here */
+    set_anchor(amiga_secs, amiga_micro, &ev);
+    last_time = anchor_time;
+    return TRUE;
 }
 
 /* --------------------------------------------------------------------------
@@ -153,6 +294,166 @@ BOOL clock_get_system_time(ULONG *amiga_secs, ULONG *amiga_micro)
     return FALSE;
 }
 
+/* Helper: anchor from TR_GETSYSTIME (only tick-accurate) */
+static BOOL anchor_from_system(void)
+{
+    struct EClockVal ev;
+    AmigaTime now;
+
+    if (!clock_get_system_time(&now.secs, &now.micro))
+        return FALSE;
+    eclock_freq = ReadEClock(&ev);
+    set_anchor(now.secs, now.micro, &ev);
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: EClock ticks since the anchor as seconds and microseconds
+ *
+ * The 64-bit tick count is divided by the EClock frequency (under
+ * 2^20) one bit at a time, so no 64-bit arithmetic is needed. Returns
+ * FALSE if the count can't be converted (EClock went backwards or
+ * the anchor is impossibly old).
+ * -------------------------------------------------------------------------- */
+
+static BOOL eclock_elapsed(const struct EClockVal *ev, ULONG *secs, ULONG *micro)
+{
+    ULONG hi, lo, q, r, bit;
+
+    hi = ev->ev_hi - anchor_eclock.ev_hi;
+    lo = ev->ev_lo - anchor_eclock.ev_lo;
+    if (ev->ev_lo < anchor_eclock.ev_lo)
+        hi--;
+    if (eclock_freq == 0 || hi >= eclock_freq)
+        return FALSE;
+
+    /* (hi:lo) / freq; hi < freq, so the quotient fits in 32 bits */
+    r = hi;
+    q = 0;
+    for (bit = 0x80000000UL; bit != 0; bit >>= 1) {
+        r = (r << 1) | ((lo & bit) ? 1 : 0);
+        q <<= 1;
+        if (r >= eclock_freq) {
+            r -= eclock_freq;
+            q |= 1;
+        }
+    }
+
+    /* r / freq in microseconds, three digits at a time */
+    *secs  = q;
+    *micro = (r * 1000UL) / eclock_freq * 1000UL;
+    *micro += (((r * 1000UL) % eclock_freq) * 1000UL) / eclock_freq;
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: read the time with EClock resolution (see below)
+ * -------------------------------------------------------------------------- */
+
+static BOOL precise_time(AmigaTime *t)
+{
+    struct EClockVal ev;
+    ULONG secs, micro;
+    AmigaTime sys;
+    LONG diff;
+
+    if (!TimerBase || !t)
+        return FALSE;
+
+    if (!anchor_valid && !anchor_from_system())
+        return FALSE;
+
+    ReadEClock(&ev);
+    if (!eclock_elapsed(&ev, &secs, &micro)) {
+        if (!anchor_from_system())
+            return FALSE;
+        *t = anchor_time;
+        return TRUE;
+    }
+
+    t->secs  = anchor_time.secs + secs;
+    t->micro = anchor_time.micro + micro;
+    if (t->micro >= 1000000UL) {
+        t->micro -= 1000000UL;
+        t->secs++;
+    }
+
+    /* Now and then make sure nobody else has set the clock */
+    if (secs - anchor_checked >= CLOCK_CHECK_SECS) {
+        if (!clock_get_system_time(&sys.secs, &sys.micro))
+            return TRUE;
+        diff = (LONG)(sys.secs - t->secs);
+        if (diff > 1 || diff < -1) {
+            anchor_from_system();
+            *t = anchor_time;
+            return TRUE;
+        }
+        diff = diff * 1000000L + (LONG)sys.micro - (LONG)t->micro;
+        if (diff > CLOCK_CHECK_MICRO || diff < -CLOCK_CHECK_MICRO) {
+            anchor_from_system();
+            *t = anchor_time;
+            return TRUE;
+        }
+        anchor_checked = secs;
+    }
+
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_get_precise_time - Read the time with EClock resolution
+ *
+ * ReadEClock() is a plain library call with microsecond resolution,
+ * where TR_GETSYSTIME is a device round trip that only advances per
+ * tick. Used for the packet timestamps. Falls back to TR_GETSYSTIME
+ * if the EClock reading can't be used.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_get_precise_time(AmigaTime *t)
+{
+    if (!precise_time(t))
+        return FALSE;
+
+    last_time = *t;
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_adjust_system_time - Add a signed offset to the running clock
+ *
+ * Reads the clock and writes it back immediately so the time spent
+ * between measuring the offset and applying it is not lost. The new
+ * time is returned through new_time if non-NULL. A step supersedes
+ * any slew in progress, since the measured offset already includes
+ * the part of it not yet applied.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_adjust_system_time(const ClockOffset *offset, AmigaTime *new_time)
+{
+    AmigaTime now;
+
+    clock_slew_stop();
+
+    if (!offset || !clock_get_precise_time(&now))
+        return FALSE;
+
+    /* offset->micro is always 0..999999, so only a forward carry is needed */
+    now.secs  += (ULONG)offset->secs;
+    now.micro += offset->micro;
+    if (now.micro >= 1000000UL) {
+        now.micro -= 1000000UL;
+        now.secs++;
+    }
+
+    if (!clock_set_system_time(now.secs, now.micro))
+        return FALSE;
+
+    if (new_time)
+        *new_time = now;
+
+    return TRUE;
+}
+
 /* --------------------------------------------------------------------------
  * clock_format_time - Format Amiga time as human-readable "date time" string
  * -------------------------------------------------------------------------- */
@@ -200,6 +501,43 @@ void clock_format_time(ULONG amiga_secs, char *buf, ULONG buf_size)
     }
 }
 
+/* --------------------------------------------------------------------------
+ * clock_read_battclock - Read the battery-backed clock
+ *
+ * Whole seconds, local Amiga time like the system clock. Returns FALSE
+ * if there is no battery clock or it holds no valid time.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_read_battclock(ULONG *amiga_secs)
+{
+    ULONG secs;
+
+    if (!BattClockBase)
+        return FALSE;
+
+    secs = ReadBattClock();
+    if (secs == 0)
+        return FALSE;
+
+    *amiga_secs = secs;
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_write_battclock - Set the battery-backed clock
+ *
+ * The system clock is read from it at the next boot.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_write_battclock(ULONG amiga_secs)
+{
+    if (!BattClockBase)
+        return FALSE;
+
+    WriteBattClock(amiga_secs);
+    return TRUE;
+}
+
 /* --------------------------------------------------------------------------
  * clock_start_timer - Start (or restart) the periodic async timer
  * -------------------------------------------------------------------------- */
@@ -275,3 +613,329 @@ BOOL clock_check_timer(void)
 
     return FALSE;
 }
+
+/* --------------------------------------------------------------------------
+ * clock_start_alarm - Fire the alarm when the system clock reaches a time
+ *
+ * amiga_secs is local Amiga time, like the system clock. A time already
+ * past fires at once. Returns FALSE if UNIT_WAITUNTIL couldn't be opened.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_start_alarm(ULONG amiga_secs)
+{
+    if (!alarm_treq)
+        return FALSE;
+
+    clock_abort_alarm();
+
+    alarm_treq->tr_node.io_Command = TR_ADDREQUEST;
+    alarm_treq->tr_time.tv_secs    = amiga_secs;
+    alarm_treq->tr_time.tv_micro   = 0;
+
+    SendIO((struct IORequest *)alarm_treq);
+    alarm_pending = TRUE;
+
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_abort_alarm - Cancel a pending alarm
+ * -------------------------------------------------------------------------- */
+
+void clock_abort_alarm(void)
+{
+    if (alarm_pending && alarm_treq) {
+        AbortIO((struct IORequest *)alarm_treq);
+        WaitIO((struct IORequest *)alarm_treq);
+        alarm_pending = FALSE;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * clock_alarm_signal - Return the signal mask for the alarm port
+ * -------------------------------------------------------------------------- */
+
+ULONG clock_alarm_signal(void)
+{
+    if (alarm_port)
+        return 1UL << alarm_port->mp_SigBit;
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_check_alarm - Check if the alarm fired and acknowledge it
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_check_alarm(void)
+{
+    if (!alarm_port || !alarm_pending)
+        return FALSE;
+
+    if (GetMsg(alarm_port) != NULL) {
+        alarm_pending = FALSE;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: add a signed number of microseconds to the system clock
+ *
+ * A step back is cut short so the clock doesn't go below the start of
+ * the current CLOCK_TICK_MICRO tick or the last time read or set. The
+ * part applied is returned through applied.
+ * -------------------------------------------------------------------------- */
+
+static BOOL clock_nudge(LONG micro, LONG *applied)
+{
+    AmigaTime now;
+    LONG m, room;
+
+    *applied = 0;
+
+    /* Read and write at EClock precision so repeated nudges don't lose
+     * the part of a tick that had passed */
+    if (!precise_time(&now))
+        return FALSE;
+
+    if (micro < 0) {
+        room = (LONG)(now.micro % CLOCK_TICK_MICRO);
+        if (last_time.secs > now.secs)
+            room = 0;
+        else if (last_time.secs == now.secs && last_time.micro >= now.micro)
+            room = 0;
+        else if (last_time.secs == now.secs &&
+                 (LONG)(now.micro - last_time.micro) < room)
+            room = (LONG)(now.micro - last_time.micro);
+        if (micro < -room)
+            micro = -room;
+        if (micro == 0) {
+            last_time = now;
+            return TRUE;
+        }
+    }
+
+    m = (LONG)now.micro + micro;
+    if (m < 0) {
+        m += 1000000L;
+        now.secs--;
+    } else if (m >= 1000000L) {
+        m -= 1000000L;
+        now.secs++;
+    }
+    now.micro = (ULONG)m;
+
+    if (!clock_set_system_time(now.secs, now.micro))
+        return FALSE;
+
+    *applied = micro;
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: queue the next slew tick
+ *
+ * While a correction is being slewed the timer runs every
+ * SLEW_PERIOD_MICRO. Otherwise, if a drift rate is set, it runs just
+ * often enough that each drift adjustment stays within SLEW_STEP_MICRO.
+ * -------------------------------------------------------------------------- */
+
+static void slew_arm(void)
+{
+    LONG rate;
+
+    if (!slew_treq || slew_pending)
+        return;
+
+    if (slew_remaining != 0) {
+        slew_quarters = SLEW_PERIOD_MICRO / 250000;
+    } else if (drift_ppb != 0) {
+        /* drift_ppb nanoseconds per second = drift_ppb / 4 per quarter */
+        rate = drift_ppb < 0 ? -drift_ppb : drift_ppb;
+        slew_quarters = (SLEW_STEP_MICRO * 4000L) / rate;
+        if (slew_quarters < 4)
+            slew_quarters = 4;
+        if (slew_quarters > DRIFT_MAX_QUARTERS)
+            slew_quarters = DRIFT_MAX_QUARTERS;
+    } else {
+        return;
+    }
+
+    slew_treq->tr_node.io_Command = TR_ADDREQUEST;
+    slew_treq->tr_time.tv_secs    = (ULONG)(slew_quarters / 4);
+    slew_treq->tr_time.tv_micro   = (ULONG)(slew_quarters % 4) * 250000UL;
+
+    SendIO((struct IORequest *)slew_treq);
+    slew_pending = TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * Helper: abort an outstanding slew tick
+ * -------------------------------------------------------------------------- */
+
+static void slew_abort(void)
+{
+    if (slew_pending && slew_treq) {
+        AbortIO((struct IORequest *)slew_treq);
+        WaitIO((struct IORequest *)slew_treq);
+        slew_pending = FALSE;
+    }
+}
+
+/* --------------------------------------------------------------------------
+ * clock_slew_start - Apply a correction gradually instead of as a step
+ *
+ * The correction is spread over many adjustments of at most
+ * SLEW_STEP_MICRO each, one every SLEW_PERIOD_MICRO. A new call
+ * replaces whatever was left of the previous correction.
+ *
+ * Returns FALSE if the slew timer is unavailable; the caller should
+ * step the clock instead.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_slew_start(LONG offset_micro)
+{
+    if (!slew_treq)
+        return FALSE;
+
+    /* A drift tick may be queued with a long period; restart at slew pace */
+    slew_abort();
+    slew_remaining = offset_micro;
+    slew_arm();
+
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_slew_stop - Abandon the rest of a slewed correction
+ *
+ * Drift compensation carries on if a rate is set.
+ * -------------------------------------------------------------------------- */
+
+void clock_slew_stop(void)
+{
+    slew_abort();
+    slew_remaining = 0;
+    slew_arm();
+}
+
+/* --------------------------------------------------------------------------
+ * clock_slew_remaining - Microseconds of correction not yet applied
+ * -------------------------------------------------------------------------- */
+
+LONG clock_slew_remaining(void)
+{
+    return slew_remaining;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_set_drift - Set the rate at which the clock is compensated
+ *
+ * ppb is in nanoseconds per second (parts per billion); positive means
+ * the local clock runs slow and time is added. 0 turns compensation
+ * off. Returns FALSE if the slew timer is unavailable.
+ * -------------------------------------------------------------------------- */
+
+BOOL clock_set_drift(LONG ppb)
+{
+    if (!slew_treq)
+        return FALSE;
+
+    if (ppb > MAX_DRIFT_PPB)
+        ppb = MAX_DRIFT_PPB;
+    if (ppb < -MAX_DRIFT_PPB)
+        ppb = -MAX_DRIFT_PPB;
+
+    /* Re-pace the timer for the new rate unless a slew is running */
+    if (slew_remaining == 0)
+        slew_abort();
+    drift_ppb = ppb;
+    slew_arm();
+
+    return TRUE;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_take_drift_applied - Drift compensation applied since last call
+ *
+ * Returns microseconds added to (or, if negative, taken from) the clock
+ * by drift compensation and resets the count.
+ * -------------------------------------------------------------------------- */
+
+LONG clock_take_drift_applied(void)
+{
+    LONG applied = drift_applied;
+
+    drift_applied = 0;
+    return applied;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_slew_signal - Return the signal mask for the slew timer port
+ * -------------------------------------------------------------------------- */
+
+ULONG clock_slew_signal(void)
+{
+    if (slew_port)
+        return 1UL << slew_port->mp_SigBit;
+
+    return 0;
+}
+
+/* --------------------------------------------------------------------------
+ * clock_handle_slew - Apply the next slew and drift adjustment
+ *
+ * Call when the slew signal is received. Applies one adjustment and
+ * re-arms the timer while there is a correction left or a drift rate
+ * is set.
+ * -------------------------------------------------------------------------- */
+
+void clock_handle_slew(void)
+{
+    LONG step, drift, applied, owed, part;
+
+    if (!slew_port || !slew_pending || GetMsg(slew_port) == NULL)
+        return;
+    slew_pending = FALSE;
+
+    step = slew_remaining;
+    if (step > SLEW_STEP_MICRO)
+        step = SLEW_STEP_MICRO;
+    else if (step < -SLEW_STEP_MICRO)
+        step = -SLEW_STEP_MICRO;
+
+    /* Drift owed for the period just elapsed, kept in nanoseconds so
+     * rates well below one microsecond per tick still add up */
+    drift_nanos += (drift_ppb / 4) * slew_quarters;
+    drift = drift_nanos / 1000;
+    drift_nanos -= drift * 1000;
+
+    if (step + drift != 0) {
+        if (!clock_nudge(step + drift, &applied)) {
+            /* Give up the slew but keep the drift owed for next time */
+            slew_remaining = 0;
+            drift_nanos += drift * 1000;
+            if (drift_nanos > DRIFT_MAX_OWED || drift_nanos < -DRIFT_MAX_OWED)
+                drift_nanos = 0;
+            slew_arm();
+            return;
+        }
+
+        /* A step back cut short: the slew, then the drift keep the rest */
+        owed = step + drift - applied;
+        if (owed != 0) {
+            part = (step < 0 && owed < step) ? step : owed;
+            if (step >= 0)
+                part = 0;
+            step  -= part;
+            drift -= owed - part;
+            drift_nanos += (owed - part) * 1000;
+        }
+    }
+
+    slew_remaining -= step;
+    drift_applied  += drift;
+    slew_arm();
+}
@@ -4,6 +4,15 @@
  * parse_line() with strncmp-based key=value parsing, manual integer
  * conversion (no atoi/sprintf), FGets/FPuts file I/O, save to both
  * ENV: and ENVARC:.
+ *
+ * The clock state drift.c learns (ClockState) goes to a file of its
+ * own, ENVARC: only, so it survives a reboot without the prefs file
+ * being rewritten after every sync.
+ *
+ * The setters note which fields actually changed. config_save() does
+ * nothing if none did, writes ENV: at once, and leaves the ENVARC:
+ * copy to config_flush() (window close, exit) so repeated saves from
+ * the window cost one write to the boot volume.
  */
 
 #include "synctime.h"
@@ -14,6 +23,14 @@
 
 static SyncConfig current_config;
 
+/* Fields changed since the last save */
+#define CONFIG_DIRTY_SERVER   0x01
+#define CONFIG_DIRTY_INTERVAL 0x02
+#define CONFIG_DIRTY_TZ       0x04
+
+static UBYTE dirty_fields = 0;
+static BOOL  envarc_pending = FALSE;  /* ENV: saved, ENVARC: not yet */
+
 /* =========================================================================
  * Helper: set all config fields to compiled-in defaults
  * ========================================================================= */
@@ -29,6 +46,20 @@ static void set_defaults(void)
     current_config.server[i] = '\0';
 
     current_config.interval = DEFAULT_INTERVAL;
+    current_config.dns_ttl = DEFAULT_DNS_TTL;
+    current_config.slew = FALSE;
+    current_config.slew_limit = DEFAULT_SLEW_LIMIT;
+    current_config.drift = TRUE;
+    current_config.battclock = FALSE;
+    current_config.max_interval = DEFAULT_MAX_INTERVAL;
+    current_config.tolerance = DEFAULT_TOLERANCE;
+    current_config.burst = DEFAULT_BURST;
+    current_config.listen = FALSE;
+    current_config.listen_delay = DEFAULT_LISTEN_DELAY;
+    current_config.listen_cal = TRUE;
+    current_config.serve = FALSE;
+    current_config.log_level = DEFAULT_LOG_LEVEL;
+    current_config.log_file[0] = '\0';
 
     for (i = 0; i < (LONG)sizeof(current_config.tz_name) - 1 && tz_src[i] != '\0'; i++)
         current_config.tz_name[i] = tz_src[i];
@@ -144,6 +175,110 @@ static void parse_line(const char *line)
             current_config.interval = val;
         }
 
+    } else if (strncmp(line, "DNSTTL=", 7) == 0) {
+        val = parse_int(line + 7, &ok);
+        if (ok) {
+            if (val < 0) val = 0;
+            if (val > MAX_DNS_TTL) val = MAX_DNS_TTL;
+            current_config.dns_ttl = val;
+        }
+
+    } else if (strncmp(line, "SLEW=", 5) == 0) {
+        val = parse_int(line + 5, &ok);
+        if (ok)
+            current_config.slew = (val != 0);
+
+    } else if (strncmp(line, "SLEWLIMIT=", 10) == 0) {
+        val = parse_int(line + 10, &ok);
+        if (ok) {
+            if (val < 0) val = 0;
+            if (val > MAX_SLEW_LIMIT) val = MAX_SLEW_LIMIT;
+            current_config.slew_limit = val;
+        }
+
+    } else if (strncmp(line, "DRIFT=", 6) == 0) {
+        val = parse_int(line + 6, &ok);
+        if (ok)
+            current_config.drift = (val != 0);
+
+    } else if (strncmp(line, "BATTCLOCK=", 10) == 0) {
+        val = parse_int(line + 10, &ok);
+        if (ok)
+            current_config.battclock = (val != 0);
+
+    } else if (strncmp(line, "MAXINTERVAL=", 12) == 0) {
+        val = parse_int(line + 12, &ok);
+        if (ok) {
+            if (val < MIN_INTERVAL) val = MIN_INTERVAL;
+            if (val > MAX_INTERVAL) val = MAX_INTERVAL;
+            current_config.max_interval = val;
+        }
+
+    } else if (strncmp(line, "TOLERANCE=", 10) == 0) {
+        val = parse_int(line + 10, &ok);
+        if (ok) {
+            if (val < 1) val = 1;
+            if (val > MAX_TOLERANCE) val = MAX_TOLERANCE;
+            current_config.tolerance = val;
+        }
+
+    } else if (strncmp(line, "BURST=", 6) == 0) {
+        val = parse_int(line + 6, &ok);
+        if (ok) {
+            if (val < 1) val = 1;
+            if (val > MAX_BURST) val = MAX_BURST;
+            current_config.burst = val;
+        }
+
+    } else if (strncmp(line, "LISTEN=", 7) == 0) {
+        val = parse_int(line + 7, &ok);
+        if (ok)
+            current_config.listen = (val != 0);
+
+    } else if (strncmp(line, "LISTENDELAY=", 12) == 0) {
+        val = parse_int(line + 12, &ok);
+        if (ok) {
+            if (val < 0) val = 0;
+            if (val > MAX_LISTEN_DELAY) val = MAX_LISTEN_DELAY;
+            current_config.listen_delay = val;
+        }
+
+    } else if (strncmp(line, "LISTENCAL=", 10) == 0) {
+        val = parse_int(line + 10, &ok);
+        if (ok)
+            current_config.listen_cal = (val != 0);
+
+    } else if (strncmp(line, "SERVE=", 6) == 0) {
+        val = parse_int(line + 6, &ok);
+        if (ok)
+            current_config.serve = (val != 0);
+
+    } else if (strncmp(line, "LOGLEVEL=", 9) == 0) {
+        val = parse_int(line + 9, &ok);
+        if (ok) {
+            if (val < LOG_ERROR) val = LOG_ERROR;
+            if (val > LOG_DEBUG) val = LOG_DEBUG;
+            current_config.log_level = val;
+        }
+
+    } else if (strncmp(line, "LOGFILE=", 8) == 0) {
+        const char *src = line + 8;
+        LONG i;
+
+        for (i = 0; i < LOG_PATH_MAX - 1 && src[i] != '\0'; i++)
+            current_config.log_file[i] = src[i];
+        current_config.log_file[i] = '\0';
+
+        /* Strip trailing whitespace and newlines */
+        while (i > 0 &&
+               (current_config.log_file[i - 1] == '\n' ||
+                current_config.log_file[i - 1] == '\r' ||
+                current_config.log_file[i - 1] == ' '  ||
+                current_config.log_file[i - 1] == '\t')) {
+            i--;
+            current_config.log_file[i] = '\0';
+        }
+
     } else if (strncmp(line, "TIMEZONE=", 9) == 0) {
         const char *src = line + 9;
         LONG i;
@@ -196,6 +331,71 @@ static BOOL save_to_path(const char *path)
     FPuts(fh, current_config.tz_name);
     FPuts(fh, "\n");
 
+    /* DNSTTL= */
+    FPuts(fh, "DNSTTL=");
+    int_to_str(current_config.dns_ttl, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* SLEW= */
+    FPuts(fh, current_config.slew ? "SLEW=1\n" : "SLEW=0\n");
+
+    /* SLEWLIMIT= */
+    FPuts(fh, "SLEWLIMIT=");
+    int_to_str(current_config.slew_limit, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* DRIFT= */
+    FPuts(fh, current_config.drift ? "DRIFT=1\n" : "DRIFT=0\n");
+
+    /* BATTCLOCK= */
+    FPuts(fh, current_config.battclock ? "BATTCLOCK=1\n" : "BATTCLOCK=0\n");
+
+    /* MAXINTERVAL= */
+    FPuts(fh, "MAXINTERVAL=");
+    int_to_str(current_config.max_interval, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* TOLERANCE= */
+    FPuts(fh, "TOLERANCE=");
+    int_to_str(current_config.tolerance, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* BURST= */
+    FPuts(fh, "BURST=");
+    int_to_str(current_config.burst, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* LISTEN= */
+    FPuts(fh, current_config.listen ? "LISTEN=1\n" : "LISTEN=0\n");
+
+    /* LISTENDELAY= */
+    FPuts(fh, "LISTENDELAY=");
+    int_to_str(current_config.listen_delay, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* LISTENCAL= */
+    FPuts(fh, current_config.listen_cal ? "LISTENCAL=1\n" : "LISTENCAL=0\n");
+
+    /* SERVE= */
+    FPuts(fh, current_config.serve ? "SERVE=1\n" : "SERVE=0\n");
+
+    /* LOGLEVEL= */
+    FPuts(fh, "LOGLEVEL=");
+    int_to_str(current_config.log_level, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* LOGFILE= */
+    FPuts(fh, "LOGFILE=");
+    FPuts(fh, current_config.log_file);
+    FPuts(fh, "\n");
+
     Close(fh);
     return TRUE;
 }
@@ -210,14 +410,16 @@ BOOL config_init(void)
     set_defaults();
     if (!config_load()) {
         /* No prefs file found -- write defaults to both locations */
-        config_save();
+        save_to_path(PREFS_ENV_PATH);
+        save_to_path(PREFS_ENVARC_PATH);
     }
     return TRUE;
 }
 
-/* config_cleanup: nothing to free (all static) */
+/* config_cleanup: write a pending ENVARC: copy (all else is static) */
 void config_cleanup(void)
 {
+    config_flush();
 }
 
 /* config_load: read and parse ENV:SyncTime.prefs line by line */
@@ -238,15 +440,28 @@ BOOL config_load(void)
     return TRUE;
 }
 
-/* config_save: write to both ENV: and ENVARC: */
+/* config_save: write changes to ENV: now, ENVARC: on config_flush() */
 BOOL config_save(void)
 {
-    BOOL ok;
+    if (dirty_fields == 0)
+        return TRUE;
 
-    ok  = save_to_path(PREFS_ENV_PATH);
-    ok &= save_to_path(PREFS_ENVARC_PATH);
+    if (!save_to_path(PREFS_ENV_PATH))
+        return FALSE;
 
-    return ok;
+    dirty_fields = 0;
+    envarc_pending = TRUE;
+    return TRUE;
+}
+
+/* config_flush: write the deferred ENVARC: copy, if any */
+BOOL config_flush(void)
+{
+    if (!envarc_pending)
+        return TRUE;
+
+    envarc_pending = FALSE;
+    return save_to_path(PREFS_ENVARC_PATH);
 }
 
 /* config_get: return pointer to static config struct */
@@ -263,9 +478,16 @@ void config_set_server(const char *server)
     if (!server)
         return;
 
-    for (i = 0; i < SERVER_NAME_MAX - 1 && server[i] != '\0'; i++)
-        current_config.server[i] = server[i];
-    current_config.server[i] = '\0';
+    for (i = 0; i < SERVER_NAME_MAX - 1 && server[i] != '\0'; i++) {
+        if (current_config.server[i] != server[i]) {
+            current_config.server[i] = server[i];
+            dirty_fields |= CONFIG_DIRTY_SERVER;
+        }
+    }
+    if (current_config.server[i] != '\0') {
+        current_config.server[i] = '\0';
+        dirty_fields |= CONFIG_DIRTY_SERVER;
+    }
 }
 
 /* config_set_interval: set with clamping */
@@ -273,7 +495,10 @@ void config_set_interval(LONG interval)
 {
     if (interval < MIN_INTERVAL) interval = MIN_INTERVAL;
     if (interval > MAX_INTERVAL) interval = MAX_INTERVAL;
-    current_config.interval = interval;
+    if (current_config.interval != interval) {
+        current_config.interval = interval;
+        dirty_fields |= CONFIG_DIRTY_INTERVAL;
+    }
 }
 
 /* config_set_tz_name: set IANA timezone name */
@@ -284,7 +509,101 @@ void config_set_tz_name(const char *name)
     if (!name)
         return;
 
-    for (i = 0; i < (LONG)sizeof(current_config.tz_name) - 1 && name[i] != '\0'; i++)
-        current_config.tz_name[i] = name[i];
-    current_config.tz_name[i] = '\0';
+    for (i = 0; i < (LONG)sizeof(current_config.tz_name) - 1 && name[i] != '\0'; i++) {
+        if (current_config.tz_name[i] != name[i]) {
+            current_config.tz_name[i] = name[i];
+            dirty_fields |= CONFIG_DIRTY_TZ;
+        }
+    }
+    if (current_config.tz_name[i] != '\0') {
+        current_config.tz_name[i] = '\0';
+        dirty_fields |= CONFIG_DIRTY_TZ;
+    }
+}
+
+/* =========================================================================
+ * Clock state (STATE_ENVARC_PATH)
+ * ========================================================================= */
+
+/* Helper: parse one state file line into state */
+static void parse_state_line(const char *line, ClockState *state)
+{
+    LONG val;
+    BOOL ok;
+
+    if (strncmp(line, "BATTSET=", 8) == 0) {
+        val = parse_int(line + 8, &ok);
+        if (ok && val > 0)
+            state->batt_set_secs = (ULONG)val;
+
+    } else if (strncmp(line, "DRIFT=", 6) == 0) {
+        val = parse_int(line + 6, &ok);
+        if (ok && val > -MAX_DRIFT_PPB && val < MAX_DRIFT_PPB) {
+            state->drift_ppb = val;
+            state->have_drift = TRUE;
+        }
+
+    } else if (strncmp(line, "BATTDRIFT=", 10) == 0) {
+        val = parse_int(line + 10, &ok);
+        if (ok && val > -MAX_DRIFT_PPB && val < MAX_DRIFT_PPB) {
+            state->batt_drift_ppb = val;
+            state->have_batt_drift = TRUE;
+        }
+    }
+}
+
+/* config_load_state: read the saved clock state; cleared if there is none */
+BOOL config_load_state(ClockState *state)
+{
+    BPTR fh;
+    char line[64];
+
+    memset(state, 0, sizeof(*state));
+
+    fh = Open(STATE_ENVARC_PATH, MODE_OLDFILE);
+    if (!fh)
+        return FALSE;
+
+    while (FGets(fh, line, sizeof(line))) {
+        parse_state_line(line, state);
+    }
+
+    Close(fh);
+    return TRUE;
+}
+
+/* config_save_state: write the clock state to ENVARC: */
+BOOL config_save_state(const ClockState *state)
+{
+    BPTR fh;
+    char buf[16];
+
+    fh = Open(STATE_ENVARC_PATH, MODE_NEWFILE);
+    if (!fh)
+        return FALSE;
+
+    /* BATTSET= */
+    FPuts(fh, "BATTSET=");
+    int_to_str((LONG)state->batt_set_secs, buf);
+    FPuts(fh, buf);
+    FPuts(fh, "\n");
+
+    /* DRIFT= */
+    if (state->have_drift) {
+        FPuts(fh, "DRIFT=");
+        int_to_str(state->drift_ppb, buf);
+        FPuts(fh, buf);
+        FPuts(fh, "\n");
+    }
+
+    /* BATTDRIFT= */
+    if (state->have_batt_drift) {
+        FPuts(fh, "BATTDRIFT=");
+        int_to_str(state->batt_drift_ppb, buf);
+        FPuts(fh, buf);
+        FPuts(fh, "\n");
+    }
+
+    Close(fh);
+    return TRUE;
 }
@@ -0,0 +1,394 @@
+/* drift.c - Clock drift estimation for SyncTime
+ *
+ * Learns the frequency error of the local clock from successive sync
+ * offsets and uses it two ways:
+ *
+ *   - the rate is handed to clock_set_drift() so the clock is nudged
+ *     continuously between syncs;
+ *   - the poll interval doubles while the residual offset stays within
+ *     the configured tolerance and halves when it doesn't, bounded by
+ *     INTERVAL and MAXINTERVAL.
+ *
+ * What was learned is kept in ENVARC:SyncTime.state (config_save_state())
+ * so compensation resumes right after a reboot. With BATTCLOCK=1 the
+ * synced time is also written back to the battery clock whenever that
+ * has drifted BATT_MAX_ERROR seconds, and the span between those writes
+ * measures the battery clock's own drift. At the next cold boot the
+ * system clock, just read from the battery clock, is corrected by the
+ * drift predicted for the time the machine was off, before any network
+ * is up.
+ *
+ * Rates are kept in parts per billion (nanoseconds per second) in a
+ * LONG, so no floating point or 64-bit math is needed on the 68000.
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+/* Shortest span a frequency sample is taken over; the VBLANK clock's
+ * 20 ms granularity swamps anything shorter */
+#define DRIFT_MIN_SPAN     60
+
+/* Weight of a new sample in the running averages: 1/DRIFT_AVG_WEIGHT */
+#define DRIFT_AVG_WEIGHT   4
+
+static BOOL  have_ref    = FALSE;  /* ref_secs holds the last good sync */
+static ULONG ref_secs    = 0;      /* Local time the clock was last corrected */
+static BOOL  have_freq   = FALSE;  /* freq_ppb holds at least one sample */
+static LONG  freq_ppb    = 0;      /* Estimated drift, ns per second */
+static LONG  jitter_micro = 0;     /* Average residual offset, microseconds */
+static ULONG poll_secs   = 0;      /* Current poll interval, 0 = configured */
+
+/* Battery clock: rewritten once off by more than BATT_MAX_ERROR
+ * seconds; drift samples need BATT_MIN_SPAN of its running free, and
+ * nothing is predicted for a machine that was off longer than
+ * BATT_MAX_SPAN (the battery may have run down) */
+#define BATT_MAX_ERROR     2
+#define BATT_MIN_SPAN      3600
+#define BATT_MAX_SPAN      (30UL * 86400UL)
+
+/* Drift change, ns per second, worth rewriting the state file for */
+#define STATE_SAVE_PPB     1000
+
+static ClockState saved;           /* As last loaded or saved */
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+/* Absolute value of a LONG */
+static LONG abs_long(LONG v)
+{
+    return v < 0 ? -v : v;
+}
+
+/* micro * 1000 / secs without overflowing 32 bits */
+static LONG rate_ppb(LONG micro, ULONG secs)
+{
+    LONG whole = micro / (LONG)secs;
+    LONG rest  = micro % (LONG)secs;
+
+    if (whole > MAX_DRIFT_PPB / 1000)
+        return MAX_DRIFT_PPB;
+    if (whole < -MAX_DRIFT_PPB / 1000)
+        return -MAX_DRIFT_PPB;
+
+    return whole * 1000 + (rest * 1000) / (LONG)secs;
+}
+
+/* Microseconds gained over secs at ppb, secs up to BATT_MAX_SPAN */
+static LONG scale_ppb(LONG ppb, ULONG secs)
+{
+    LONG ppm  = ppb / 1000;
+    LONG rest = ppb % 1000;
+
+    return ppm * (LONG)secs + (rest * (LONG)(secs / 1000)) +
+           (rest * (LONG)(secs % 1000)) / 1000;
+}
+
+/* Poll interval bounds from the current config */
+static ULONG min_poll(void)
+{
+    return (ULONG)config_get()->interval;
+}
+
+static ULONG max_poll(void)
+{
+    SyncConfig *cfg = config_get();
+
+    if (!cfg->drift || cfg->max_interval < cfg->interval)
+        return (ULONG)cfg->interval;
+    return (ULONG)cfg->max_interval;
+}
+
+/* Take a new reference point and return to the shortest interval */
+static void restart(const AmigaTime *now)
+{
+    have_ref  = TRUE;
+    ref_secs  = now->secs;
+    poll_secs = min_poll();
+}
+
+/* Battery clock minus true time in microseconds, 0 if it is too far
+ * off to have drifted there. The battery clock reads whole seconds,
+ * so it is on average half a second ahead of what it returns. */
+static LONG batt_error(ULONG batt, const AmigaTime *now)
+{
+    LONG secs = (LONG)(batt - now->secs);
+
+    if (secs > 2000 || secs < -2000)
+        return 0;
+    return secs * 1000000L + 500000L - (LONG)now->micro;
+}
+
+/* Note the battery clock's drift since it was last set */
+static void batt_sample(LONG err_micro, ULONG now_secs)
+{
+    ULONG span;
+    LONG sample;
+
+    if (saved.batt_set_secs == 0 || err_micro == 0 ||
+        now_secs < saved.batt_set_secs)
+        return;
+
+    span = now_secs - saved.batt_set_secs;
+    if (span < BATT_MIN_SPAN || span > BATT_MAX_SPAN)
+        return;
+
+    sample = rate_ppb(err_micro, span);
+    if (abs_long(sample) >= MAX_DRIFT_PPB)
+        return;  /* Set behind our back */
+
+    if (!saved.have_batt_drift) {
+        saved.batt_drift_ppb  = sample;
+        saved.have_batt_drift = TRUE;
+    } else {
+        saved.batt_drift_ppb += (sample - saved.batt_drift_ppb) / DRIFT_AVG_WEIGHT;
+    }
+}
+
+/* Correct the system clock for the battery clock's predicted drift
+ * while the machine was off */
+static void batt_predict(void)
+{
+    ULONG batt, now, micro;
+    LONG predict;
+    ClockOffset offset;
+
+    if (!saved.have_batt_drift || saved.batt_set_secs == 0 ||
+        !clock_read_battclock(&batt) || !clock_get_system_time(&now, &micro))
+        return;
+
+    /* Only while the system clock still is the battery clock's reading,
+     * i.e. not when SyncTime is restarted after a sync */
+    if (now + 1 < batt || now > batt + 1 || batt < saved.batt_set_secs ||
+        batt - saved.batt_set_secs > BATT_MAX_SPAN)
+        return;
+
+    /* Below BATT_MAX_ERROR the battery clock wasn't worth setting
+     * either; a restart after such a correction then sees the system
+     * clock too far from the battery clock to apply it again */
+    predict = scale_ppb(saved.batt_drift_ppb, batt - saved.batt_set_secs);
+    if (abs_long(predict) <= BATT_MAX_ERROR * 1000000L)
+        return;
+
+    /* A clock that ran fast is ahead: subtract what it gained */
+    predict = -predict;
+    offset.secs  = predict >= 0 ? predict / 1000000L
+                                : -((999999L - predict) / 1000000L);
+    offset.micro = (ULONG)(predict - offset.secs * 1000000L);
+    if (clock_adjust_system_time(&offset, NULL))
+        log_msg(LOG_INFO, "Clock corrected for battery clock drift");
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/*
+ * drift_reset - Forget everything learned so far
+ *
+ * Stops drift compensation and returns to the configured interval.
+ */
+void drift_reset(void)
+{
+    have_ref     = FALSE;
+    have_freq    = FALSE;
+    freq_ppb     = 0;
+    jitter_micro = 0;
+    poll_secs    = 0;
+    clock_set_drift(0);
+    clock_take_drift_applied();
+}
+
+/*
+ * drift_update - Feed the result of a successful sync
+ *
+ * offset is what the sync measured, now the local time once it was
+ * corrected. The offset is what the clock drifted by since the last
+ * sync after compensation, so the compensation applied in between is
+ * added back to get the uncorrected drift. Spans longer than a few
+ * maximum intervals are treated like a step, since the clock was
+ * probably not running freely all that time, and so are offsets that
+ * imply more drift than any real clock has.
+ */
+void drift_update(const ClockOffset *offset, const AmigaTime *now)
+{
+    SyncConfig *cfg = config_get();
+    LONG micro, raw, sample;
+    ULONG span;
+
+    micro = sntp_offset_to_micro(offset);
+    raw = micro + clock_take_drift_applied();
+
+    if (!cfg->drift) {
+        if (have_ref || have_freq)
+            drift_reset();
+        return;
+    }
+
+    /* First sync, or the clock was set behind our back */
+    if (!have_ref || now->secs < ref_secs ||
+        now->secs - ref_secs > MAX_INTERVAL * 4UL) {
+        restart(now);
+        return;
+    }
+
+    span = now->secs - ref_secs;
+    if (span < DRIFT_MIN_SPAN)
+        return;  /* Keep the reference, measure over a longer span */
+
+    /* More than any crystal drifts: a step, not drift */
+    sample = rate_ppb(raw, span);
+    if (abs_long(sample) >= MAX_DRIFT_PPB) {
+        restart(now);
+        return;
+    }
+    if (!have_freq) {
+        freq_ppb     = sample;
+        jitter_micro = 0;  /* Uncompensated so far; says nothing of jitter */
+        have_freq    = TRUE;
+    } else {
+        freq_ppb     += (sample - freq_ppb) / DRIFT_AVG_WEIGHT;
+        jitter_micro += (abs_long(micro) - jitter_micro) / DRIFT_AVG_WEIGHT;
+    }
+    ref_secs = now->secs;
+
+    clock_set_drift(freq_ppb);
+
+    /* Lengthen the interval while comfortably within tolerance, back
+     * off as soon as either the residual or the jitter exceeds it */
+    poll_secs = drift_poll_interval();
+    if (abs_long(micro) > cfg->tolerance * 1000L ||
+        jitter_micro > cfg->tolerance * 1000L) {
+        poll_secs /= 2;
+    } else if (abs_long(micro) < cfg->tolerance * 500L &&
+               jitter_micro < cfg->tolerance * 500L) {
+        poll_secs *= 2;
+    }
+}
+
+/*
+ * drift_clock_shifted - The clock was moved on purpose, by secs
+ *
+ * Moves the reference point along so a DST change (dst.c) isn't
+ * mistaken for drift or a step.
+ */
+void drift_clock_shifted(LONG secs)
+{
+    if (have_ref)
+        ref_secs = (ULONG)((LONG)ref_secs + secs);
+}
+
+/*
+ * drift_poll_interval - Seconds until the next sync after a success
+ */
+ULONG drift_poll_interval(void)
+{
+    ULONG lo = min_poll(), hi = max_poll();
+
+    if (poll_secs < lo)
+        return lo;
+    if (poll_secs > hi)
+        return hi;
+    return poll_secs;
+}
+
+/*
+ * drift_freq_ppb - Current drift estimate, ns per second
+ *
+ * Returns FALSE if not enough syncs have been seen yet.
+ */
+BOOL drift_freq_ppb(LONG *ppb)
+{
+    *ppb = freq_ppb;
+    return have_freq;
+}
+
+/*
+ * drift_restore - Resume from the saved clock state at startup
+ *
+ * Restores the drift estimate (with DRIFT=1) and, with BATTCLOCK=1,
+ * applies the battery clock correction predicted for a cold boot.
+ */
+void drift_restore(void)
+{
+    SyncConfig *cfg = config_get();
+
+    config_load_state(&saved);
+
+    if (cfg->drift && saved.have_drift) {
+        freq_ppb     = saved.drift_ppb;
+        jitter_micro = 0;
+        have_freq    = TRUE;
+        clock_set_drift(freq_ppb);
+    }
+
+    if (cfg->battclock)
+        batt_predict();
+}
+
+/*
+ * drift_persist - Save what a successful sync taught us
+ *
+ * Call after drift_update(). With BATTCLOCK=1 the battery clock is
+ * checked and, if off by more than BATT_MAX_ERROR, sampled for drift
+ * and set. The state file is only rewritten when that happened or the
+ * drift estimate moved by STATE_SAVE_PPB.
+ */
+void drift_persist(void)
+{
+    AmigaTime now;
+    ULONG batt, secs;
+    LONG micro, err;
+    BOOL changed = FALSE;
+
+    if (config_get()->battclock && clock_read_battclock(&batt) &&
+        clock_get_precise_time(&now)) {
+        /* The time a slew in progress is heading for */
+        micro = (LONG)now.micro + clock_slew_remaining();
+        while (micro < 0) {
+            micro += 1000000L;
+            now.secs--;
+        }
+        now.secs  += (ULONG)micro / 1000000UL;
+        now.micro  = (ULONG)micro % 1000000UL;
+
+        err = batt_error(batt, &now);
+        if (err == 0 || abs_long(err) > BATT_MAX_ERROR * 1000000L ||
+            saved.batt_set_secs == 0) {
+            batt_sample(err, now.secs);
+            secs = now.secs + (now.micro >= 500000UL ? 1 : 0);
+            if (clock_write_battclock(secs)) {
+                saved.batt_set_secs = secs;
+                changed = TRUE;
+                log_msg(LOG_DEBUG, "Battery clock set");
+            }
+        }
+    }
+
+    if (have_freq && (!saved.have_drift ||
+                      abs_long(freq_ppb - saved.drift_ppb) >= STATE_SAVE_PPB)) {
+        saved.drift_ppb  = freq_ppb;
+        saved.have_drift = TRUE;
+        changed = TRUE;
+    }
+
+    if (changed)
+        config_save_state(&saved);
+}
+
+/*
+ * drift_cleanup - Save the latest drift estimate at exit
+ */
+void drift_cleanup(void)
+{
+    if (have_freq && (!saved.have_drift || freq_ppb != saved.drift_ppb)) {
+        saved.drift_ppb  = freq_ppb;
+        saved.have_drift = TRUE;
+        config_save_state(&saved);
+    }
+}
@@ -0,0 +1,109 @@
+/* dst.c - Daylight saving time transitions between syncs
+ *
+ * The system clock runs on local time, and a sync is what moves it
+ * to a new UTC offset. Without help a DST change would wait for the
+ * next sync, up to MAXINTERVAL later. Instead the next transition of
+ * the configured zone (tz_next_transition()) is armed on the clock
+ * alarm, which fires when the system clock reaches the local time
+ * of the change; the clock is then shifted by the DST offset and
+ * TZ/TZONE are set again, with no network involved.
+ *
+ * The schedule is worked out again after every successful sync and
+ * timezone change, so a clock that was far off when it was armed
+ * doesn't leave it at the wrong time. Working out UTC from the clock
+ * is ambiguous during the hour repeated when DST ends, so a
+ * transition once applied is never armed again.
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+static ULONG dst_next  = 0;  /* UTC of the armed transition, 0 = none */
+static LONG  dst_shift = 0;  /* Seconds to add to the clock then */
+static ULONG dst_done  = 0;  /* UTC of the last transition applied */
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/*
+ * dst_schedule - Arm the alarm for the zone's next DST change
+ *
+ * Cancels whatever was armed before. Nothing is armed for a zone
+ * without DST or if the alarm isn't available.
+ */
+void dst_schedule(void)
+{
+    const TZEntry *tz = tz_find_by_name(config_get()->tz_name);
+    ULONG now, micro, utc;
+    LONG before;
+
+    clock_abort_alarm();
+    dst_next = 0;
+
+    if (!tz || !clock_get_system_time(&now, &micro))
+        return;
+
+    utc = sntp_amiga_to_ntp(now, tz) - NTP_TO_AMIGA_EPOCH;
+    if (utc < dst_done)
+        utc = dst_done;
+
+    dst_next = tz_next_transition(tz, utc);
+    if (dst_next == 0)
+        return;
+
+    before    = tz_get_offset_mins(tz, dst_next - 1);
+    dst_shift = (tz_get_offset_mins(tz, dst_next) - before) * 60;
+    if (!clock_start_alarm(dst_next + (ULONG)(before * 60)))
+        dst_next = 0;
+}
+
+/* dst_cancel: disarm the alarm (commodity disabled) */
+void dst_cancel(void)
+{
+    clock_abort_alarm();
+    dst_next = 0;
+}
+
+/*
+ * dst_handle - Apply the transition once the alarm fired
+ *
+ * Call when clock_alarm_signal() is received. Shifts the clock, keeping
+ * a slew in progress, sets TZ/TZONE and arms the next transition.
+ * Returns the seconds the clock was moved by, 0 if it wasn't.
+ */
+LONG dst_handle(void)
+{
+    const TZEntry *tz;
+    ClockOffset offset;
+    LONG slew, moved = 0;
+
+    if (!clock_check_alarm() || dst_next == 0)
+        return 0;
+
+    dst_done = dst_next;
+
+    if (dst_shift != 0) {
+        slew = clock_slew_remaining();
+        offset.secs  = dst_shift;
+        offset.micro = 0;
+        if (clock_adjust_system_time(&offset, NULL)) {
+            if (slew != 0)
+                clock_slew_start(slew);
+            drift_clock_shifted(dst_shift);
+            log_msg(LOG_INFO, dst_shift > 0 ? "Daylight saving time started"
+                                            : "Daylight saving time ended");
+            moved = dst_shift;
+        }
+    }
+
+    tz = tz_find_by_name(config_get()->tz_name);
+    if (tz)
+        tz_set_env(tz);
+
+    dst_schedule();
+    return moved;
+}
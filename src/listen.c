@@ -0,0 +1,273 @@
+/* listen.c - Broadcast and multicast NTP client for SyncTime
+ *
+ * With LISTEN=1 SyncTime opens a socket on UDP port 123 (see
+ * network_open_listen()) and takes its time from a server's periodic
+ * mode 5 broadcasts instead of sending queries. Broadcasts are taken
+ * from one server at a time: the first one heard, until it has been
+ * silent for a whole poll interval.
+ *
+ * A broadcast can't measure its own delay. With LISTENCAL=1 the first
+ * broadcast from a new server starts one ordinary query to it
+ * (sync_start_address()); half its round-trip delay then stands in
+ * for the path, and that exchange also sets the clock. Until then, or
+ * if the server doesn't answer queries, LISTENDELAY is assumed.
+ *
+ * Samples are collected between poll timer ticks. When the timer
+ * fires, listen_apply() runs them through sntp_filter_samples() and
+ * applies the best one; if nothing was heard main.c queries SERVER
+ * as usual.
+ *
+ * The same socket carries SERVE=1 client requests; listen_receive()
+ * hands those to serve_request().
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+#define CAL_NONE   0  /* No calibration wanted, or it failed */
+#define CAL_WANTED 1  /* New server, query not started yet */
+#define CAL_SENT   2  /* Query started */
+#define CAL_DONE   3  /* one_way_micro is measured */
+
+static ULONG      source_addr = 0;    /* Broadcast server, 0 = none yet */
+static LONG       one_way_micro = 0;  /* Measured delay once CAL_DONE */
+static UBYTE      cal_state = CAL_NONE;
+static BOOL       grace_pending = FALSE;  /* Socket just opened */
+
+static SNTPSample samples[MAX_BURST];  /* Newest overwrite oldest */
+static LONG       sample_count = 0;
+static LONG       sample_next = 0;
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+/* Helper to format IP address into buffer */
+static void format_ip(ULONG ip_addr, char *buf)
+{
+    UBYTE *ip = (UBYTE *)&ip_addr;
+    int i, val, pos = 0;
+
+    for (i = 0; i < 4; i++) {
+        val = ip[i];
+        if (val >= 100) { buf[pos++] = '0' + (val / 100); val %= 100; }
+        if (val >= 10 || ip[i] >= 100) { buf[pos++] = '0' + (val / 10); val %= 10; }
+        buf[pos++] = '0' + val;
+        if (i < 3) buf[pos++] = '.';
+    }
+    buf[pos] = '\0';
+}
+
+/* Helper to append an unsigned decimal number */
+static char *append_uint(char *p, ULONG val)
+{
+    char tmp[12];
+    int i = 0;
+
+    do {
+        tmp[i++] = '0' + (char)(val % 10);
+        val /= 10;
+    } while (val > 0);
+
+    while (i > 0)
+        *p++ = tmp[--i];
+
+    return p;
+}
+
+/* Helper to forget the current server after it fell silent */
+static void drop_source(void)
+{
+    source_addr = 0;
+    cal_state = CAL_NONE;
+    sample_count = 0;
+    sample_next = 0;
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/*
+ * listen_start - Open the NTP port socket if LISTEN=1 or SERVE=1
+ *
+ * Called every time the poll timer fires, so a socket lost to an
+ * error or a missing network is retried. Returns TRUE if listening.
+ */
+BOOL listen_start(void)
+{
+    SyncConfig *cfg = config_get();
+    BOOL joined;
+
+    if (!cfg->listen && !cfg->serve)
+        return FALSE;
+    if (network_listen_is_open())
+        return TRUE;
+
+    if (!network_open_listen(&joined)) {
+        log_msg(LOG_WARN, "WARNING: Can't listen on UDP port 123");
+        return FALSE;
+    }
+
+    if (cfg->listen)
+        log_msg(LOG_INFO, joined ? "Listening for NTP broadcasts and multicasts"
+                                 : "Listening for NTP broadcasts");
+    if (cfg->serve)
+        log_msg(LOG_INFO, "Serving SNTP on UDP port 123");
+    drop_source();
+    grace_pending = cfg->listen;
+    return TRUE;
+}
+
+/* listen_stop: close the NTP port socket */
+void listen_stop(void)
+{
+    network_close_listen();
+    drop_source();
+}
+
+/* listen_active: TRUE while the NTP port socket is open */
+BOOL listen_active(void)
+{
+    return network_listen_is_open();
+}
+
+/*
+ * listen_waiting - TRUE once after the socket was opened
+ *
+ * Lets main.c give the first broadcast LISTEN_GRACE_SECS to arrive
+ * before falling back to a query.
+ */
+BOOL listen_waiting(void)
+{
+    BOOL was = grace_pending;
+
+    grace_pending = FALSE;
+    return was;
+}
+
+/*
+ * listen_receive - Read every queued packet
+ *
+ * Called when network_wait() reports the socket readable. Client
+ * requests go to serve_request(); otherwise anything but a valid
+ * mode 5 packet from the current server is ignored.
+ */
+void listen_receive(void)
+{
+    UBYTE packet[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    const TZEntry *tz;
+    AmigaTime t4;
+    ULONG from;
+    UWORD from_port;
+    LONG bytes, delay;
+    char msg[48];
+
+    tz = tz_find_by_name(config_get()->tz_name);
+
+    while ((bytes = network_recv_listen(packet, NTP_PACKET_SIZE, &from,
+                                        &from_port, &t4)) >= 0) {
+        if (bytes < NTP_PACKET_SIZE)
+            continue;
+        if ((packet[0] & 0x07) == NTP_MODE_CLIENT) {
+            serve_request(packet, from, from_port, &t4);
+            continue;
+        }
+        if (!config_get()->listen || !sntp_parse_response(packet, &resp) ||
+            resp.mode != NTP_MODE_BROADCAST)
+            continue;
+
+        if (source_addr == 0) {
+            source_addr = from;
+            cal_state = config_get()->listen_cal ? CAL_WANTED : CAL_NONE;
+            if (log_enabled(LOG_INFO)) {
+                strcpy(msg, "Broadcast server ");
+                format_ip(from, msg + 17);
+                log_msg(LOG_INFO, msg);
+            }
+        } else if (from != source_addr) {
+            continue;
+        }
+
+        delay = (cal_state == CAL_DONE) ? one_way_micro
+                                        : config_get()->listen_delay * 1000L;
+        sntp_compute_broadcast(&resp, &t4, delay, tz, &samples[sample_next]);
+        sample_next = (sample_next + 1) % MAX_BURST;
+        if (sample_count < MAX_BURST)
+            sample_count++;
+    }
+}
+
+/*
+ * listen_calibration_target - Server to calibrate against, once
+ *
+ * TRUE (with *ip_addr set) the first time it is called after a new
+ * server was heard with LISTENCAL=1.
+ */
+BOOL listen_calibration_target(ULONG *ip_addr)
+{
+    if (cal_state != CAL_WANTED)
+        return FALSE;
+
+    cal_state = CAL_SENT;
+    *ip_addr = source_addr;
+    return TRUE;
+}
+
+/*
+ * listen_synced - Note a successful sync
+ *
+ * If it was the calibration query, half its delay becomes the one-way
+ * delay for later broadcasts. Collected samples predate the new clock
+ * setting either way, so they are dropped.
+ */
+void listen_synced(ULONG ip_addr, LONG delay_micro)
+{
+    char msg[48];
+    char *p;
+
+    if (cal_state == CAL_SENT && ip_addr == source_addr) {
+        one_way_micro = delay_micro / 2;
+        cal_state = CAL_DONE;
+        if (log_enabled(LOG_DEBUG)) {
+            strcpy(msg, "Broadcast delay ");
+            p = append_uint(msg + 16, (ULONG)one_way_micro / 1000);
+            strcpy(p, " ms");
+            log_msg(LOG_DEBUG, msg);
+        }
+    }
+
+    sample_count = 0;
+    sample_next = 0;
+}
+
+/*
+ * listen_apply - Apply the broadcasts heard since the last poll
+ *
+ * Returns STATUS_OK or STATUS_ERROR once a sample was applied, or
+ * STATUS_IDLE if nothing was heard (the server is dropped, so the
+ * next one heard takes over) and the caller should query instead.
+ */
+LONG listen_apply(void)
+{
+    SNTPSample best;
+
+    if (!network_listen_is_open() || sample_count == 0) {
+        drop_source();
+        return STATUS_IDLE;
+    }
+
+    /* A calibration still pending by now didn't get an answer */
+    if (cal_state == CAL_SENT)
+        cal_state = CAL_NONE;
+
+    sntp_filter_samples(samples, sample_count, &best);
+    sample_count = 0;
+    sample_next = 0;
+
+    return sync_apply_sample(source_addr, &best);
+}
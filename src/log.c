@@ -0,0 +1,162 @@
+/* log.c - Levelled log sink for SyncTime
+ *
+ * Every message has a severity. Messages above the configured
+ * LOGLEVEL are dropped before anything else happens; callers that
+ * build a message with the number formatters check log_enabled()
+ * first so filtered chatter costs nothing.
+ *
+ * Accepted messages go to the window's log ring (the console instead
+ * for the ONCE command, see log_set_console()) and, if LOGFILE is
+ * set, into a line buffer with a timestamp. The buffer is appended
+ * to the file with a single Write() per sync (log_flush() from
+ * finish_sync()), or earlier if it fills up.
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+#define LOG_BUF_SIZE   1024
+#define LOG_STAMP_LEN  20    /* "YYYY-MM-DD HH:MM:SS " */
+
+static char file_buf[LOG_BUF_SIZE];
+static LONG file_buf_used = 0;
+static BOOL console = FALSE;   /* Print to Output(), not the window */
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+/* Helper to write a zero-padded two-digit number */
+static char *append_2digits(char *p, ULONG val)
+{
+    *p++ = '0' + (char)(val / 10 % 10);
+    *p++ = '0' + (char)(val % 10);
+    return p;
+}
+
+/* Helper to format the current local time as "YYYY-MM-DD HH:MM:SS " */
+static char *append_stamp(char *p)
+{
+    ULONG secs, micro, days;
+    LONG year;
+    UBYTE month, day;
+
+    if (!clock_get_system_time(&secs, &micro))
+        secs = 0;
+
+    days = secs / 86400;
+    secs = secs % 86400;
+    cal_civil_from_days(days, &year, &month, &day);
+
+    p = append_2digits(p, (ULONG)year / 100);
+    p = append_2digits(p, (ULONG)year);
+    *p++ = '-';
+    p = append_2digits(p, month);
+    *p++ = '-';
+    p = append_2digits(p, day);
+    *p++ = ' ';
+    p = append_2digits(p, secs / 3600);
+    *p++ = ':';
+    p = append_2digits(p, secs / 60 % 60);
+    *p++ = ':';
+    p = append_2digits(p, secs % 60);
+    *p++ = ' ';
+    return p;
+}
+
+/* Helper to queue one line for the log file */
+static void file_append(const char *text)
+{
+    LONG len;
+    char *p;
+
+    for (len = 0; text[len] != '\0'; len++)
+        ;
+    if (len > LOG_BUF_SIZE - LOG_STAMP_LEN - 1)
+        len = LOG_BUF_SIZE - LOG_STAMP_LEN - 1;
+
+    if (file_buf_used + LOG_STAMP_LEN + len + 1 > LOG_BUF_SIZE)
+        log_flush();
+
+    p = append_stamp(file_buf + file_buf_used);
+    memcpy(p, text, len);
+    p += len;
+    *p++ = '\n';
+    file_buf_used = p - file_buf;
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/* log_enabled: TRUE if messages of this level are kept */
+BOOL log_enabled(LONG level)
+{
+    return level <= config_get()->log_level;
+}
+
+/*
+ * log_msg - Log one message
+ *
+ * Shown in the window log (or printed) and, with LOGFILE set, queued
+ * for the file.
+ */
+void log_msg(LONG level, const char *text)
+{
+    SyncConfig *cfg = config_get();
+
+    if (level > cfg->log_level)
+        return;
+
+    if (console) {
+        PutStr(text);
+        PutStr("\n");
+    } else {
+        window_log(text);
+    }
+
+    if (cfg->log_file[0] != '\0')
+        file_append(text);
+}
+
+/* log_set_console: print messages to the CLI instead of the window */
+void log_set_console(BOOL on)
+{
+    console = on;
+}
+
+/*
+ * log_flush - Append the queued lines to the log file
+ *
+ * Opens the file once, seeks to the end and writes the whole buffer.
+ * If the file can't be opened the lines are dropped, so a missing
+ * volume doesn't make the buffer grow or retry on every message.
+ */
+void log_flush(void)
+{
+    const char *path = config_get()->log_file;
+    BPTR fh;
+
+    if (file_buf_used == 0)
+        return;
+
+    if (path[0] != '\0') {
+        fh = Open(path, MODE_READWRITE);
+        if (fh) {
+            Seek(fh, 0, OFFSET_END);
+            Write(fh, file_buf, file_buf_used);
+            Close(fh);
+        }
+    }
+
+    file_buf_used = 0;
+}
+
+/* log_cleanup: write out anything still queued */
+void log_cleanup(void)
+{
+    log_flush();
+}
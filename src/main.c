@@ -1,8 +1,8 @@
 /* main.c - SyncTime entry point and commodity event loop
  *
- * Ties together all modules: config, network, sntp, clock, window.
- * Implements the commodity broker, hotkey handling, periodic sync,
- * and the main event loop.
+ * Ties together all modules: config, network, sync, sntp, clock, window.
+ * Implements the commodity broker, hotkey handling, periodic sync
+ * scheduling, and the main event loop.
  */
 
 #include "synctime.h"
@@ -39,6 +39,7 @@ struct Library       *CxBase        = NULL;
 struct Library       *UtilityBase   = NULL;
 struct Library       *SocketBase    = NULL;
 struct Device        *TimerBase     = NULL;
+APTR                  BattClockBase = NULL;
 
 /* Reaction class library bases */
 struct Library       *WindowBase      = NULL;
@@ -59,6 +60,9 @@ static BOOL cx_enabled  = TRUE;
 /* Sync state */
 static SyncStatus sync_status;
 static BOOL first_sync_done = FALSE;  /* Track if we've ever synced successfully */
+static ULONG failed_syncs = 0;        /* Consecutive failures, for backoff */
+static ULONG probe_waited = 0;        /* Seconds of failed network probes */
+static ULONG random_seed  = 1;        /* Backoff jitter */
 
 /* Custom event ID for hotkey */
 #define EVT_HOTKEY 1
@@ -71,7 +75,7 @@ static BOOL open_libraries(void);
 static void close_libraries(void);
 static BOOL setup_commodity(int argc, char **argv);
 static void cleanup_commodity(void);
-static void perform_sync(void);
+static ULONG get_next_interval(void);
 static void event_loop(void);
 
 /* =========================================================================
@@ -80,19 +84,6 @@ static void event_loop(void);
 
 static BOOL open_libraries(void)
 {
-    IntuitionBase = (struct IntuitionBase *)OpenLibrary("intuition.library",
-                                                        LIB_VERSION);
-    if (IntuitionBase == NULL)
-        return FALSE;
-
-    GfxBase = (struct GfxBase *)OpenLibrary("graphics.library", LIB_VERSION);
-    if (GfxBase == NULL)
-        return FALSE;
-
-    GadToolsBase = OpenLibrary("gadtools.library", LIB_VERSION);
-    if (GadToolsBase == NULL)
-        return FALSE;
-
     CxBase = OpenLibrary("commodities.library", LIB_VERSION);
     if (CxBase == NULL)
         return FALSE;
@@ -101,39 +92,8 @@ static BOOL open_libraries(void)
     if (UtilityBase == NULL)
         return FALSE;
 
-    /* Reaction classes */
-    WindowBase = OpenLibrary("window.class", LIB_VERSION);
-    if (WindowBase == NULL)
-        return FALSE;
-
-    LayoutBase = OpenLibrary("gadgets/layout.gadget", LIB_VERSION);
-    if (LayoutBase == NULL)
-        return FALSE;
-
-    ButtonBase = OpenLibrary("gadgets/button.gadget", LIB_VERSION);
-    if (ButtonBase == NULL)
-        return FALSE;
-
-    StringBase = OpenLibrary("gadgets/string.gadget", LIB_VERSION);
-    if (StringBase == NULL)
-        return FALSE;
-
-    IntegerBase = OpenLibrary("gadgets/integer.gadget", LIB_VERSION);
-    if (IntegerBase == NULL)
-        return FALSE;
-
-    ChooserBase = OpenLibrary("gadgets/chooser.gadget", LIB_VERSION);
-    if (ChooserBase == NULL)
-        return FALSE;
-
-    ListBrowserBase = OpenLibrary("gadgets/listbrowser.gadget", LIB_VERSION);
-    if (ListBrowserBase == NULL)
-        return FALSE;
-
-    LabelBase = OpenLibrary("images/label.image", LIB_VERSION);
-    if (LabelBase == NULL)
-        return FALSE;
-
+    /* intuition, graphics, gadtools and the Reaction classes are
+     * opened by window_open() when the window is first shown */
     /* bsdsocket.library is opened by network_init() */
     /* timer.device is opened by clock_init() */
 
@@ -142,41 +102,8 @@ static BOOL open_libraries(void)
 
 static void close_libraries(void)
 {
-    /* Close in reverse order; NULL-safe */
-
-    /* Reaction classes first (reverse order of opening) */
-    if (LabelBase != NULL) {
-        CloseLibrary(LabelBase);
-        LabelBase = NULL;
-    }
-    if (ListBrowserBase != NULL) {
-        CloseLibrary(ListBrowserBase);
-        ListBrowserBase = NULL;
-    }
-    if (ChooserBase != NULL) {
-        CloseLibrary(ChooserBase);
-        ChooserBase = NULL;
-    }
-    if (IntegerBase != NULL) {
-        CloseLibrary(IntegerBase);
-        IntegerBase = NULL;
-    }
-    if (StringBase != NULL) {
-        CloseLibrary(StringBase);
-        StringBase = NULL;
-    }
-    if (ButtonBase != NULL) {
-        CloseLibrary(ButtonBase);
-        ButtonBase = NULL;
-    }
-    if (LayoutBase != NULL) {
-        CloseLibrary(LayoutBase);
-        LayoutBase = NULL;
-    }
-    if (WindowBase != NULL) {
-        CloseLibrary(WindowBase);
-        WindowBase = NULL;
-    }
+    /* Close in reverse order; NULL-safe. The GUI libraries are closed
+     * by window_cleanup() */
 
     /* Standard libraries */
     if (UtilityBase != NULL) {
@@ -187,18 +114,6 @@ static void close_libraries(void)
         CloseLibrary(CxBase);
         CxBase = NULL;
     }
-    if (GadToolsBase != NULL) {
-        CloseLibrary(GadToolsBase);
-        GadToolsBase = NULL;
-    }
-    if (GfxBase != NULL) {
-        CloseLibrary((struct Library *)GfxBase);
-        GfxBase = NULL;
-    }
-    if (IntuitionBase != NULL) {
-        CloseLibrary((struct Library *)IntuitionBase);
-        IntuitionBase = NULL;
-    }
 }
 
 /* =========================================================================
@@ -288,14 +203,12 @@ static void cleanup_commodity(void)
 }
 
 /* =========================================================================
- * perform_sync - Execute a single NTP synchronization
+ * start_sync / finish_sync - Begin and complete an NTP synchronization
  *
- * Logs each step to the scrollable log and updates status on completion.
+ * The sync itself runs in steps from event_loop() (see sync.c); these
+ * only manage the status display and the periodic timer around it.
  * ========================================================================= */
 
-/* Re-entrancy guard */
-static BOOL sync_in_progress = FALSE;
-
 /* Helper to update main status field */
 static void set_status(int status_code, const char *text)
 {
@@ -308,166 +221,167 @@ static void set_status(int status_code, const char *text)
         strcpy(sync_status.status_text, text);
     }
 
-    if (window_is_open())
-        window_update_status(&sync_status);
+    window_update_status(&sync_status);
 }
 
-/* Helper to format IP address into buffer */
-static void format_ip(ULONG ip_addr, char *buf)
+static void start_sync(void)
 {
-    UBYTE *ip = (UBYTE *)&ip_addr;
-    int i, val, pos = 0;
-
-    for (i = 0; i < 4; i++) {
-        val = ip[i];
-        if (val >= 100) { buf[pos++] = '0' + (val / 100); val %= 100; }
-        if (val >= 10 || ip[i] >= 100) { buf[pos++] = '0' + (val / 10); val %= 10; }
-        buf[pos++] = '0' + val;
-        if (i < 3) buf[pos++] = '.';
+    if (!sync_start()) {
+        log_msg(LOG_DEBUG, "Sync already in progress, skipping");
+        return;
     }
-    buf[pos] = '\0';
+    set_status(STATUS_SYNCING, "Syncing...");
 }
 
-static void perform_sync(void)
+/* The clock was moved for DST: keep the shown times on the same
+ * instants, and redo a sync whose timestamps straddle the change */
+static void clock_shifted(LONG secs)
 {
-    SyncConfig *cfg;
-    const TZEntry *tz;
-    ULONG ip_addr;
-    UBYTE packet[NTP_PACKET_SIZE];
-    ULONG ntp_secs;
-    ULONG ntp_frac;
-    LONG bytes;
-    ULONG amiga_secs;
-    char msg[64];
-
-    /* Prevent re-entrancy */
-    if (sync_in_progress) {
-        window_log("Sync already in progress, skipping");
-        return;
+    if (sync_status.last_sync_secs != 0) {
+        sync_status.last_sync_secs += (ULONG)secs;
+        clock_format_time(sync_status.last_sync_secs, sync_status.last_sync_text,
+                          sizeof(sync_status.last_sync_text));
     }
-    sync_in_progress = TRUE;
-
-    /* Get current configuration */
-    cfg = config_get();
-
-    /* Look up timezone entry */
-    tz = tz_find_by_name(cfg->tz_name);
-    if (tz == NULL) {
-        window_log("WARNING: Unknown timezone, using UTC");
-        /* Fall through with NULL tz - tz_get_offset_mins handles NULL */
+    if (sync_status.next_sync_secs != 0) {
+        sync_status.next_sync_secs += (ULONG)secs;
+        clock_format_time(sync_status.next_sync_secs, sync_status.next_sync_text,
+                          sizeof(sync_status.next_sync_text));
     }
+    window_update_status(&sync_status);
 
-    /* Step 1: Resolve server hostname */
-    set_status(STATUS_SYNCING, "Syncing...");
-    strcpy(msg, "Resolving ");
-    {
-        int i;
-        for (i = 0; i < 40 && cfg->server[i]; i++)
-            msg[10 + i] = cfg->server[i];
-        msg[10 + i] = '\0';
+    if (sync_busy()) {
+        sync_abort();
+        start_sync();
     }
-    window_log(msg);
+}
 
-    if (!network_resolve(cfg->server, &ip_addr)) {
-        window_log("ERROR: DNS lookup failed");
-        set_status(STATUS_ERROR, "DNS failed");
-        sync_in_progress = FALSE;
-        return;
-    }
+static void finish_sync(LONG result)
+{
+    const AmigaTime *now;
 
-    /* Log resolved IP */
-    strcpy(msg, "Resolved to ");
-    format_ip(ip_addr, msg + 12);
-    window_log(msg);
-
-    /* Step 2: Build and send SNTP request packet */
-    window_log("Sending NTP request to port 123...");
-    sntp_build_request(packet);
-    if (!network_send_udp(ip_addr, NTP_PORT, packet, NTP_PACKET_SIZE)) {
-        window_log("ERROR: Failed to send UDP packet");
-        set_status(STATUS_ERROR, "Send failed");
-        sync_in_progress = FALSE;
-        return;
-    }
-    window_log("Request sent, waiting for response...");
-
-    /* Step 3: Wait for response (5 second timeout) */
-    bytes = network_recv_udp(packet, NTP_PACKET_SIZE, 5);
-    if (bytes < 0) {
-        window_log("ERROR: Timeout waiting for response");
-        set_status(STATUS_ERROR, "Timeout");
-        sync_in_progress = FALSE;
-        return;
-    }
-    if (bytes < NTP_PACKET_SIZE) {
-        window_log("ERROR: Response too short");
-        set_status(STATUS_ERROR, "Bad response");
-        sync_in_progress = FALSE;
-        return;
-    }
-    window_log("Received 48-byte response");
-
-    /* Step 4: Parse SNTP response */
-    window_log("Parsing NTP response...");
-    if (!sntp_parse_response(packet, &ntp_secs, &ntp_frac)) {
-        window_log("ERROR: Invalid NTP packet format");
-        set_status(STATUS_ERROR, "Invalid response");
-        sync_in_progress = FALSE;
-        return;
+    /* Statistics were updated by the sync; show and publish them */
+    stats_format(sync_status.stats_text);
+    stats_export();
+
+    if (result != STATUS_OK) {
+        failed_syncs++;
+        set_status(STATUS_ERROR, sync_result_text());
+    } else {
+        first_sync_done = TRUE;
+        failed_syncs = 0;
+        listen_synced(sync_result_addr(), sync_result_delay());
+        serve_synced(sync_result_addr(), sync_result_stratum(),
+                     sync_result_delay(), sync_result_time());
+        dst_schedule();
+
+        /* Update sync status with timestamps */
+        now = sync_result_time();
+        sync_status.status = STATUS_OK;
+        strcpy(sync_status.status_text, sync_result_text());
+        sync_status.last_sync_secs = now->secs;
+        clock_format_time(now->secs, sync_status.last_sync_text,
+                          sizeof(sync_status.last_sync_text));
+        sync_status.next_sync_secs = now->secs + get_next_interval();
+        clock_format_time(sync_status.next_sync_secs, sync_status.next_sync_text,
+                          sizeof(sync_status.next_sync_text));
+        window_update_status(&sync_status);
     }
-    window_log("Response valid, extracting time...");
 
-    /* Step 5: Convert NTP time to Amiga time */
-    amiga_secs = sntp_ntp_to_amiga(ntp_secs, tz);
+    /* Back off if sync failed, otherwise use the adaptive interval */
+    if (cx_enabled)
+        clock_start_timer(get_next_interval());
 
-    /* Step 6: Set the system clock */
-    window_log("Setting system clock...");
-    if (!clock_set_system_time(amiga_secs, 0)) {
-        window_log("ERROR: Failed to set system time");
-        set_status(STATUS_ERROR, "Clock set failed");
-        sync_in_progress = FALSE;
-        return;
-    }
+    /* One write per sync for the log file */
+    log_flush();
 
-    /* Success! */
-    window_log("Clock synchronized successfully!");
-    first_sync_done = TRUE;
-
-    /* Update sync status with timestamps */
-    sync_status.status = STATUS_OK;
-    strcpy(sync_status.status_text, "Synchronized");
-    sync_status.last_sync_secs = amiga_secs;
-    clock_format_time(amiga_secs, sync_status.last_sync_text,
-                      sizeof(sync_status.last_sync_text));
-    sync_status.next_sync_secs = amiga_secs + cfg->interval;
-    clock_format_time(sync_status.next_sync_secs, sync_status.next_sync_text,
-                      sizeof(sync_status.next_sync_text));
-    if (window_is_open())
-        window_update_status(&sync_status);
+    /* Drop the GUI libraries if the window has been hidden a while */
+    window_expire();
+}
 
-    sync_in_progress = FALSE;
+/*
+ * poll_time - The poll timer fired
+ *
+ * With LISTEN=1, apply the broadcasts heard since the last poll. A
+ * query is only sent when none were heard; right after the socket
+ * opened the first broadcast gets LISTEN_GRACE_SECS to arrive first.
+ */
+static void poll_time(void)
+{
+    ULONG now, micro;
+    LONG result;
+
+    if (listen_start()) {
+        result = listen_apply();
+        if (result != STATUS_IDLE) {
+            finish_sync(result);
+            return;
+        }
+        if (listen_waiting() && clock_get_system_time(&now, &micro)) {
+            sync_status.next_sync_secs = now + LISTEN_GRACE_SECS;
+            clock_format_time(sync_status.next_sync_secs, sync_status.next_sync_text,
+                              sizeof(sync_status.next_sync_text));
+            set_status(STATUS_IDLE, "Listening...");
+            clock_start_timer(LISTEN_GRACE_SECS);
+            return;
+        }
+    }
+
+    start_sync();
 }
 
 /* =========================================================================
  * get_next_interval - Return timer interval based on sync history
  *
- * Before first successful sync: return STARTUP_RETRY_INTERVAL (1s) for rapid retry.
- * After first success, if last sync failed: return RETRY_INTERVAL (30s).
- * After first success, if last sync succeeded: return configured interval.
+ * Before first successful sync: back off from 2s up to STARTUP_RETRY_MAX.
+ * After first success, if last sync failed: back off from RETRY_INTERVAL
+ * (30s) up to the poll interval.
+ * After first success, if last sync succeeded: return the adaptive interval,
+ * which stays between the configured interval and MAXINTERVAL.
+ * Never sooner than the servers asked for (Kiss-of-Death or poll field).
+ *
+ * Backoff delays are jittered by +/-25% so machines that lost the
+ * network together don't all retry in step.
  * ========================================================================= */
 
+/* Helper: next pseudo-random number (LCG, good enough for jitter) */
+static ULONG next_random(void)
+{
+    random_seed = random_seed * 1103515245UL + 12345UL;
+    return random_seed >> 16;
+}
+
+/* Helper: base doubled per consecutive failure, capped, then jittered */
+static ULONG backoff_interval(ULONG base, ULONG cap)
+{
+    ULONG delay = base;
+    ULONG i;
+
+    for (i = 1; i < failed_syncs && delay < cap; i++)
+        delay *= 2;
+    if (delay > cap)
+        delay = cap;
+
+    return delay - delay / 4 + next_random() % (delay / 2 + 1);
+}
+
 static ULONG get_next_interval(void)
 {
-    /* Before first successful sync, retry every 1 second */
+    ULONG interval;
+
+    /* Before first successful sync, back off quickly to a short ceiling;
+     * the network probe still runs every second in between */
     if (!first_sync_done) {
-        return STARTUP_RETRY_INTERVAL;
+        interval = backoff_interval(STARTUP_RETRY_INTERVAL * 2, STARTUP_RETRY_MAX);
+    } else if (sync_status.status == STATUS_OK) {
+        /* After first success, use normal schedule or back off on failure */
+        interval = drift_poll_interval();
+    } else {
+        interval = backoff_interval(RETRY_INTERVAL, drift_poll_interval());
     }
 
-    /* After first success, use normal schedule or 30s retry on failure */
-    if (sync_status.status == STATUS_OK) {
-        return (ULONG)config_get()->interval;
-    }
-    return RETRY_INTERVAL;
+    if (interval < sync_hold_secs())
+        interval = sync_hold_secs();
+    return interval;
 }
 
 /* =========================================================================
@@ -477,30 +391,68 @@ static ULONG get_next_interval(void)
 static void event_loop(void)
 {
     ULONG broker_sig = 1UL << broker_port->mp_SigBit;
-    ULONG timer_sig, win_sig;
-    ULONG signals;
+    ULONG timer_sig, slew_sig, alarm_sig, win_sig;
+    ULONG signals, cal_addr;
+    BOOL readable, heard;
+    LONG result, moved;
     CxMsg *cxmsg;
 
     while (running) {
+        /* Redraw whatever the last pass changed, once */
+        window_refresh();
+
         timer_sig = clock_timer_signal();
+        slew_sig = clock_slew_signal();
+        alarm_sig = clock_alarm_signal();
         win_sig = window_signal();
 
-        signals = Wait(broker_sig | timer_sig | win_sig | SIGBREAKF_CTRL_C);
+        /* Wait() for signals; while a sync is waiting for replies this
+         * also wakes on the socket or the reply deadline */
+        readable = FALSE;
+        heard = FALSE;
+        signals = network_wait(broker_sig | timer_sig | slew_sig | alarm_sig |
+                               win_sig | SIGBREAKF_CTRL_C,
+                               sync_wait_timeout(),
+                               sync_awaiting() ? &readable : NULL,
+                               listen_active() ? &heard : NULL);
 
         /* CTRL+C: exit */
         if (signals & SIGBREAKF_CTRL_C)
             break;
 
-        /* Timer fired: sync and restart timer */
+        /* Timer fired: start a sync; timer restarts when it finishes.
+         * Until the first success, probe the network cheaply first and
+         * only sync once it's up (or the probe has failed for so long
+         * that the stack may just not report an address). */
         if ((signals & timer_sig) && clock_check_timer()) {
             /* Timer actually completed - acknowledged by clock_check_timer() */
-            perform_sync();
-            if (cx_enabled) {
-                /* Use retry interval (30s) if sync failed, otherwise configured interval */
-                clock_start_timer(get_next_interval());
+            if (!first_sync_done && probe_waited < NETWORK_PROBE_MAX &&
+                !network_ready()) {
+                probe_waited += STARTUP_RETRY_INTERVAL;
+                clock_start_timer(STARTUP_RETRY_INTERVAL);
+            } else {
+                probe_waited = 0;
+                poll_time();
             }
         }
 
+        /* Broadcasts: collect them; a new server gets one calibration
+         * query if LISTENCAL=1 */
+        if (heard) {
+            listen_receive();
+            if (cx_enabled && listen_calibration_target(&cal_addr) &&
+                sync_start_address(cal_addr))
+                set_status(STATUS_SYNCING, "Calibrating...");
+        }
+
+        /* Slew timer: apply the next small clock adjustment */
+        if (signals & slew_sig)
+            clock_handle_slew();
+
+        /* Alarm: a DST transition is due */
+        if ((signals & alarm_sig) && (moved = dst_handle()) != 0)
+            clock_shifted(moved);
+
         /* Commodity messages */
         if (signals & broker_sig) {
             while ((cxmsg = (CxMsg *)GetMsg(broker_port)) != NULL) {
@@ -524,12 +476,17 @@ static void event_loop(void)
                                 ActivateCxObj(broker, FALSE);
                                 cx_enabled = FALSE;
                                 clock_abort_timer();
+                                dst_cancel();
+                                if (sync_busy()) {
+                                    sync_abort();
+                                    set_status(STATUS_IDLE, "Disabled");
+                                }
                                 break;
                             case CXCMD_ENABLE:
                                 ActivateCxObj(broker, TRUE);
                                 cx_enabled = TRUE;
-                                perform_sync();
-                                clock_start_timer(get_next_interval());
+                                dst_schedule();
+                                start_sync();
                                 break;
                             case CXCMD_KILL:
                                 running = FALSE;
@@ -558,21 +515,171 @@ static void event_loop(void)
         if ((signals & win_sig) && window_is_open()) {
             SyncConfig *cfg = config_get();
             LONG old_interval = cfg->interval;
-            BOOL sync_now = window_handle_events(cfg, &sync_status);
+            char old_tz[sizeof(cfg->tz_name)];
+            BOOL sync_now;
+
+            strcpy(old_tz, cfg->tz_name);
+            sync_now = window_handle_events(cfg, &sync_status);
+
+            /* A new timezone has other transitions */
+            if (strcmp(old_tz, cfg->tz_name) != 0 && cx_enabled)
+                dst_schedule();
 
             /* Handle "Sync Now" button */
             if (sync_now && cx_enabled) {
                 clock_abort_timer();
-                perform_sync();
-                clock_start_timer(get_next_interval());
+                start_sync();
             }
-            /* If interval changed, restart timer */
-            else if (cfg->interval != old_interval && cx_enabled) {
+            /* If interval changed, restart timer (unless a sync will) */
+            else if (cfg->interval != old_interval && cx_enabled && !sync_busy()) {
                 clock_abort_timer();
                 clock_start_timer(get_next_interval());
             }
         }
+
+        /* Advance the sync in progress by one step */
+        if (sync_busy()) {
+            result = sync_step(readable);
+            if (result != STATUS_SYNCING)
+                finish_sync(result);
+        }
+    }
+}
+
+/* =========================================================================
+ * run_once - ONCE: sync the clock one time from the CLI, then exit
+ *
+ * For S:Startup-Sequence: no broker, window or resident event loop,
+ * and no libraries beyond dos, timer.device and bsdsocket. The prefs
+ * are read as usual; SERVER overrides the server for this run only and
+ * TIMEOUT bounds the wait for the network and the sync together.
+ * Log messages are printed. Slewing is off, since nothing stays
+ * around to finish it.
+ *
+ * Returns 0 once the clock was set, 5 if the sync failed, timed out or
+ * was broken off, 10 for bad arguments and 20 if setup failed.
+ * ========================================================================= */
+
+#define ONCE_TEMPLATE "ONCE/S,SERVER/K,TIMEOUT/N"
+
+static int run_once(void)
+{
+    LONG args[3] = { 0, 0, 0 };
+    struct RDArgs *rdargs;
+    SyncConfig *cfg;
+    const TZEntry *tz;
+    ULONG timeout, start, now, micro, signals, wait_ms, left, waited = 0;
+    ULONG timer_sig;
+    BOOL readable;
+    LONG result = STATUS_ERROR;
+    int rc = 20;  /* RETURN_FAIL */
+
+    rdargs = ReadArgs(ONCE_TEMPLATE, args, NULL);
+    if (!rdargs) {
+        PrintFault(IoErr(), CX_NAME);
+        return 10;  /* RETURN_ERROR */
+    }
+
+    if (!config_init())
+        goto cleanup;
+    cfg = config_get();
+    if (args[1])
+        config_set_server((const char *)args[1]);
+    timeout = args[2] ? (ULONG)*(LONG *)args[2] : ONCE_TIMEOUT;
+    cfg->slew = FALSE;
+    log_set_console(TRUE);
+
+    tz_init();
+    tz = tz_find_by_name(cfg->tz_name);
+    if (tz)
+        tz_set_env(tz);
+
+    if (!network_init() || !clock_init())
+        goto cleanup;
+    drift_restore();
+    rc = 5;  /* RETURN_WARN */
+
+    /* Network first, checked once a second */
+    while (!network_ready()) {
+        if (waited >= timeout) {
+            PutStr("Network not available\n");
+            goto cleanup;
+        }
+        if (SetSignal(0, SIGBREAKF_CTRL_C) & SIGBREAKF_CTRL_C) {
+            PutStr("***Break\n");
+            goto cleanup;
+        }
+        Delay(TICKS_PER_SECOND);
+        waited++;
+    }
+
+    /* The same steps event_loop() runs, without the rest of it. Each
+     * wait is capped at the TIMEOUT left, and the periodic timer fires
+     * at the deadline in case a wait can't keep its own timeout. */
+    clock_get_system_time(&start, &micro);
+    left = timeout - waited;
+    clock_start_timer(left > 0 ? left : 1);
+    timer_sig = clock_timer_signal();
+    if (!sync_start())
+        goto cleanup;
+    do {
+        clock_get_system_time(&now, &micro);
+        left = (now - start < timeout - waited) ? timeout - waited - (now - start) : 0;
+        wait_ms = sync_wait_timeout();
+        if (left < wait_ms / 1000)
+            wait_ms = left * 1000;
+
+        readable = FALSE;
+        signals = network_wait(SIGBREAKF_CTRL_C | timer_sig, wait_ms,
+                               sync_awaiting() ? &readable : NULL, NULL);
+        if (signals & SIGBREAKF_CTRL_C) {
+            sync_abort();
+            PutStr("***Break\n");
+            goto cleanup;
+        }
+        if ((signals & timer_sig) && clock_check_timer())
+            left = 0;
+
+        result = sync_step(readable);
+
+        clock_get_system_time(&now, &micro);
+        if (result == STATUS_SYNCING &&
+            (left == 0 || now - start + waited >= timeout)) {
+            sync_abort();
+            PutStr("Timed out\n");
+            goto cleanup;
+        }
+    } while (result == STATUS_SYNCING);
+
+    PutStr(sync_result_text());
+    PutStr("\n");
+    if (result == STATUS_OK)
+        rc = 0;  /* RETURN_OK */
+
+cleanup:
+    drift_cleanup();
+    clock_cleanup();
+    network_cleanup();
+    tz_cleanup();
+    log_cleanup();
+    config_cleanup();
+    FreeArgs(rdargs);
+
+    return rc;
+}
+
+/* Helper: TRUE if a CLI argument is the ONCE keyword, in any case */
+static BOOL is_once_arg(const char *arg)
+{
+    const char *word = "ONCE";
+
+    while (*word != '\0') {
+        if ((*arg & 0xDF) != *word)
+            return FALSE;
+        arg++;
+        word++;
     }
+    return (*arg == '\0');
 }
 
 /* =========================================================================
@@ -582,6 +689,13 @@ static void event_loop(void)
 int main(int argc, char **argv)
 {
     int result = 20;  /* RETURN_FAIL */
+    int i;
+
+    /* From the CLI, ONCE skips the commodity altogether */
+    for (i = 1; i < argc; i++) {
+        if (is_once_arg(argv[i]))
+            return run_once();
+    }
 
     memset(&sync_status, 0, sizeof(sync_status));
     strcpy(sync_status.status_text, "Starting...");
@@ -594,6 +708,9 @@ int main(int argc, char **argv)
     if (!config_init())
         goto cleanup;
 
+    /* Locate the timezone data file, if any */
+    tz_init();
+
     /* Set TZ/TZONE environment variables from configured timezone */
     {
         SyncConfig *cfg = config_get();
@@ -608,18 +725,23 @@ int main(int argc, char **argv)
     if (!clock_init())
         goto cleanup;
 
+    /* Saved drift, and the battery clock's drift while switched off */
+    drift_restore();
+
     if (!setup_commodity(argc, argv))
         goto cleanup;
 
-    /* Schedule initial sync immediately (1 second intervals until first success) */
+    /* Schedule initial network probe (1 second intervals until it passes) */
     if (cx_enabled) {
         ULONG now, micro;
         clock_get_system_time(&now, &micro);
+        random_seed = now ^ micro;
         sync_status.next_sync_secs = now + STARTUP_RETRY_INTERVAL;
         clock_format_time(sync_status.next_sync_secs, sync_status.next_sync_text,
                           sizeof(sync_status.next_sync_text));
         strcpy(sync_status.status_text, "Waiting for network...");
         clock_start_timer(STARTUP_RETRY_INTERVAL);
+        dst_schedule();
     }
 
     /* Run event loop */
@@ -628,11 +750,17 @@ int main(int argc, char **argv)
     result = 0;  /* RETURN_OK */
 
 cleanup:
-    window_close();
+    sync_abort();
+    dst_cancel();
+    drift_cleanup();
+    listen_stop();
+    window_cleanup();
     clock_abort_timer();
     cleanup_commodity();
     clock_cleanup();
     network_cleanup();
+    tz_cleanup();
+    log_cleanup();
     config_cleanup();
     close_libraries();
 
@@ -6,6 +6,7 @@
 
 #include "synctime.h"
 
+#include <exec/execbase.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -15,6 +16,49 @@
 /* Static state: current socket file descriptor, -1 when not open */
 static LONG sock_fd = -1;
 
+/* Socket bound to NTP_PORT for broadcasts (LISTEN=1) and client
+ * requests (SERVE=1), -1 when not open */
+static LONG listen_fd = -1;
+
+/* NTP multicast group 224.0.1.1, network byte order */
+#define NTP_MULTICAST_ADDR 0xE0000101UL
+
+/* DNS cache: gethostbyname() blocks the whole task on most stacks, so
+ * each hostname's address list is kept for config->dns_ttl seconds.
+ * Addresses that stop answering are skipped until all of them have
+ * failed, which forces a fresh lookup. */
+#define DNS_CACHE_HOSTS 4
+
+typedef struct {
+    char  hostname[SERVER_NAME_MAX];
+    ULONG addrs[MAX_SERVER_ADDRS];
+    BOOL  failed[MAX_SERVER_ADDRS];
+    LONG  count;         /* 0 = slot unused */
+    LONG  next;          /* Rotation: index handed out first */
+    ULONG resolved_at;   /* Amiga time of the lookup */
+} DNSCacheEntry;
+
+static DNSCacheEntry dns_cache[DNS_CACHE_HOSTS];
+static LONG dns_cache_victim = 0;  /* Round-robin replacement slot */
+
+/* Penalty table: addresses that sent a Kiss-of-Death are held back
+ * until a deadline, independent of the DNS cache so a fresh lookup
+ * returning the same address doesn't lift the hold. RATE holds double
+ * with every strike from PENALTY_BASE_SECS; DENY and RSTR hold for
+ * PENALTY_DENY_SECS. A good reply clears the strikes. */
+#define PENALTY_SLOTS      16
+#define PENALTY_BASE_SECS  64
+#define PENALTY_MAX_STRIKE 10          /* 64 s << 10 = about 18 hours */
+#define PENALTY_DENY_SECS  MAX_INTERVAL
+
+typedef struct {
+    ULONG ip_addr;       /* 0 = slot unused */
+    ULONG until;         /* Amiga time the hold ends */
+    UBYTE strikes;       /* RATE kisses in a row */
+} PenaltyEntry;
+
+static PenaltyEntry penalties[PENALTY_SLOTS];
+
 /*
  * network_init - Initialize network subsystem
  *
@@ -26,7 +70,11 @@ static LONG sock_fd = -1;
 BOOL network_init(void)
 {
     sock_fd = -1;
+    listen_fd = -1;
     SocketBase = NULL;
+    memset(dns_cache, 0, sizeof(dns_cache));
+    dns_cache_victim = 0;
+    memset(penalties, 0, sizeof(penalties));
     return TRUE;
 }
 
@@ -47,6 +95,34 @@ static BOOL network_ensure_open(void)
     return (SocketBase != NULL);
 }
 
+/*
+ * network_ready - Cheap check whether a sync could succeed yet
+ *
+ * Looks for bsdsocket.library in the system library list first, so
+ * nothing is loaded from LIBS: while the stack hasn't started, then
+ * asks the stack for the primary interface address. No address, or
+ * only loopback, means no interface has been configured yet.
+ *
+ * Returns TRUE if the stack is running with an interface up.
+ */
+BOOL network_ready(void)
+{
+    struct Node *lib;
+    ULONG host;
+
+    if (SocketBase == NULL) {
+        Forbid();
+        lib = FindName(&SysBase->LibList, "bsdsocket.library");
+        Permit();
+
+        if (lib == NULL || !network_ensure_open())
+            return FALSE;
+    }
+
+    host = (ULONG)gethostid();
+    return (host != 0 && (host >> 24) != 127);
+}
+
 /*
  * network_cleanup - Close socket and bsdsocket.library
  *
@@ -59,6 +135,8 @@ void network_cleanup(void)
         sock_fd = -1;
     }
 
+    network_close_listen();
+
     if (SocketBase) {
         CloseLibrary(SocketBase);
         SocketBase = NULL;
@@ -66,68 +144,359 @@ void network_cleanup(void)
 }
 
 /*
- * network_resolve - Resolve hostname to IPv4 address
+ * Helper: find the cache entry for hostname, or NULL
+ */
+static DNSCacheEntry *dns_cache_find(const char *hostname)
+{
+    LONG i;
+
+    for (i = 0; i < DNS_CACHE_HOSTS; i++) {
+        if (dns_cache[i].count > 0 &&
+            strcmp(dns_cache[i].hostname, hostname) == 0)
+            return &dns_cache[i];
+    }
+    return NULL;
+}
+
+/* Helper: find the penalty entry for an address, NULL if none */
+static PenaltyEntry *penalty_find(ULONG ip_addr)
+{
+    LONG i;
+
+    for (i = 0; i < PENALTY_SLOTS; i++) {
+        if (penalties[i].ip_addr == ip_addr && ip_addr != 0)
+            return &penalties[i];
+    }
+    return NULL;
+}
+
+/*
+ * Helper: seconds left on an address's hold, 0 if it may be queried
  *
- * Uses gethostbyname() from bsdsocket.library to resolve
- * the given hostname. The result is in network byte order.
+ * A clock that moved backwards past the deadline by more than a full
+ * hold ends it rather than leaving the address stuck.
+ */
+static ULONG penalty_left(ULONG ip_addr)
+{
+    PenaltyEntry *p = penalty_find(ip_addr);
+    ULONG now, micro;
+
+    if (p == NULL || !clock_get_system_time(&now, &micro) || now >= p->until)
+        return 0;
+    if (p->until - now > PENALTY_DENY_SECS)
+        return 0;
+    return p->until - now;
+}
+
+/*
+ * Helper: check whether a cache entry can still be used
  *
- * Returns TRUE on success, FALSE on failure.
+ * Stale when older than the configured TTL (or the clock moved
+ * backwards past the lookup), or when every address has failed or
+ * is held back by a Kiss-of-Death.
  */
-BOOL network_resolve(const char *hostname, ULONG *ip_addr)
+static BOOL dns_cache_usable(const DNSCacheEntry *e)
 {
-    struct hostent *h;
+    ULONG now, micro;
+    ULONG ttl = (ULONG)config_get()->dns_ttl;
+    LONG i;
 
-    if (!network_ensure_open())
+    if (ttl == 0 || !clock_get_system_time(&now, &micro))
         return FALSE;
+    if (now < e->resolved_at || now - e->resolved_at >= ttl)
+        return FALSE;
+
+    for (i = 0; i < e->count; i++) {
+        if (!e->failed[i] && penalty_left(e->addrs[i]) == 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Helper: look up hostname and store every address in the cache
+ *
+ * Returns the entry, or NULL if the lookup failed.
+ */
+static DNSCacheEntry *dns_cache_refresh(const char *hostname)
+{
+    struct hostent *h;
+    DNSCacheEntry *e;
+    ULONG micro;
+    LONG i;
 
     h = gethostbyname((STRPTR)hostname);
-    if (h == NULL)
-        return FALSE;
+    if (h == NULL || h->h_length != sizeof(ULONG) || h->h_addr_list[0] == NULL)
+        return NULL;
 
-    memcpy(ip_addr, h->h_addr_list[0], sizeof(ULONG));
-    return TRUE;
+    e = dns_cache_find(hostname);
+    if (e == NULL) {
+        e = &dns_cache[dns_cache_victim];
+        dns_cache_victim = (dns_cache_victim + 1) % DNS_CACHE_HOSTS;
+    }
+
+    for (i = 0; i < SERVER_NAME_MAX - 1 && hostname[i] != '\0'; i++)
+        e->hostname[i] = hostname[i];
+    e->hostname[i] = '\0';
+
+    for (i = 0; i < MAX_SERVER_ADDRS && h->h_addr_list[i] != NULL; i++) {
+        memcpy(&e->addrs[i], h->h_addr_list[i], sizeof(ULONG));
+        e->failed[i] = FALSE;
+    }
+    e->count = i;
+    e->next = 0;
+    if (!clock_get_system_time(&e->resolved_at, &micro))
+        e->resolved_at = 0;
+
+    return e;
 }
 
 /*
- * network_send_udp - Send a UDP packet
+ * network_resolve_all - Resolve hostname to all of its IPv4 addresses
  *
- * Creates a new UDP socket (closing any previous one), sets a
- * 5-second receive timeout via SO_RCVTIMEO, builds the destination
- * address, and sends the data.
+ * Answers from the DNS cache when the entry is fresh and at least one
+ * of its addresses still works; otherwise calls gethostbyname() from
+ * bsdsocket.library and refills the cache. Working addresses are
+ * copied into addrs (network byte order), starting at a rotating
+ * index so a truncated list doesn't always favour the same server.
+ * *cached is set to TRUE if no lookup was needed.
  *
- * The socket is kept open after a successful send so that
- * network_recv_udp() can receive the reply.
+ * Addresses held back by a Kiss-of-Death are left out. If hold_secs
+ * is non-NULL it receives the shortest remaining hold among them, or
+ * 0 if none was left out.
  *
- * 68000 is big-endian, same as network byte order, so no
- * byte swapping is needed for port or address values.
+ * Returns the number of addresses stored, 0 on failure.
+ */
+LONG network_resolve_all(const char *hostname, ULONG *addrs, LONG max_addrs,
+                         BOOL *cached, ULONG *hold_secs)
+{
+    DNSCacheEntry *e;
+    LONG count = 0;
+    LONG i, idx;
+    ULONG left;
+
+    if (cached)
+        *cached = FALSE;
+    if (hold_secs)
+        *hold_secs = 0;
+
+    if (!network_ensure_open())
+        return 0;
+
+    e = dns_cache_find(hostname);
+    if (e != NULL && dns_cache_usable(e)) {
+        if (cached)
+            *cached = TRUE;
+    } else {
+        DNSCacheEntry *stale = e;
+
+        e = dns_cache_refresh(hostname);
+        if (e == NULL) {
+            /* Lookup failed: an old answer is better than none */
+            if (stale == NULL)
+                return 0;
+            e = stale;
+            for (i = 0; i < e->count; i++)
+                e->failed[i] = FALSE;
+        }
+    }
+
+    for (i = 0; i < e->count && count < max_addrs; i++) {
+        idx = (e->next + i) % e->count;
+        left = penalty_left(e->addrs[idx]);
+        if (left > 0) {
+            if (hold_secs && (*hold_secs == 0 || left < *hold_secs))
+                *hold_secs = left;
+        } else if (!e->failed[idx]) {
+            addrs[count++] = e->addrs[idx];
+        }
+    }
+    e->next = (e->next + 1) % e->count;
+
+    return count;
+}
+
+/*
+ * network_mark_address - Record whether a cached address answered
+ *
+ * Failed addresses are skipped by network_resolve_all() until the
+ * entry expires or every address has failed. An answer also clears
+ * the address's Kiss-of-Death strikes.
+ */
+void network_mark_address(ULONG ip_addr, BOOL ok)
+{
+    PenaltyEntry *p;
+    LONG i, j;
+
+    for (i = 0; i < DNS_CACHE_HOSTS; i++) {
+        for (j = 0; j < dns_cache[i].count; j++) {
+            if (dns_cache[i].addrs[j] == ip_addr)
+                dns_cache[i].failed[j] = !ok;
+        }
+    }
+
+    if (ok && (p = penalty_find(ip_addr)) != NULL)
+        p->ip_addr = 0;
+}
+
+/*
+ * network_address_held - TRUE while a Kiss-of-Death holds the address back
+ */
+BOOL network_address_held(ULONG ip_addr)
+{
+    return (penalty_left(ip_addr) > 0);
+}
+
+/*
+ * network_kiss_address - Hold an address back after a Kiss-of-Death
+ *
+ * RATE holds the address for PENALTY_BASE_SECS, doubled per strike
+ * in a row, but at least poll_secs (the interval the server asked
+ * for). DENY and RSTR hold it for PENALTY_DENY_SECS. Other codes are
+ * not penalised. Replaces an expired entry, or the one ending first,
+ * when the table is full.
+ *
+ * Returns the length of the hold in seconds, 0 if none.
+ */
+ULONG network_kiss_address(ULONG ip_addr, UBYTE kiss, ULONG poll_secs)
+{
+    PenaltyEntry *p;
+    ULONG now, micro, hold;
+    LONG i;
+
+    if (kiss != KISS_RATE && kiss != KISS_DENY && kiss != KISS_RSTR)
+        return 0;
+    if (!clock_get_system_time(&now, &micro))
+        return 0;
+
+    p = penalty_find(ip_addr);
+    if (p == NULL) {
+        p = &penalties[0];
+        for (i = 1; i < PENALTY_SLOTS && p->ip_addr != 0; i++) {
+            if (penalties[i].ip_addr == 0 || penalties[i].until < p->until)
+                p = &penalties[i];
+        }
+        p->ip_addr = ip_addr;
+        p->strikes = 0;
+    }
+
+    if (kiss == KISS_RATE) {
+        hold = (ULONG)PENALTY_BASE_SECS << p->strikes;
+        if (p->strikes < PENALTY_MAX_STRIKE)
+            p->strikes++;
+        if (hold < poll_secs)
+            hold = poll_secs;
+        if (hold > PENALTY_DENY_SECS)
+            hold = PENALTY_DENY_SECS;
+    } else {
+        hold = PENALTY_DENY_SECS;
+    }
+
+    p->until = now + hold;
+    return hold;
+}
+
+/*
+ * network_open_udp - Make sure the long-lived UDP socket exists
+ *
+ * The socket is created and bound to an ephemeral local port the
+ * first time the network is usable, then reused for every sync so
+ * the stack doesn't have to build and tear down a socket each time.
+ * It is only recreated after network_close_udp(), which the send
+ * and receive paths call when the stack reports a real error.
+ *
+ * All requests of one sync are sent from this socket, so every reply
+ * arrives on the same descriptor and one WaitSelect() covers them.
  *
  * Returns TRUE on success, FALSE on failure.
  */
-BOOL network_send_udp(ULONG ip_addr, UWORD port,
-                      const UBYTE *data, ULONG len)
+BOOL network_open_udp(void)
 {
-    struct timeval tv;
-    struct sockaddr_in dest;
-    LONG result;
+    struct sockaddr_in local;
+
+    if (sock_fd >= 0)
+        return TRUE;
 
     if (!network_ensure_open())
         return FALSE;
 
-    /* Close any previously open socket */
+    sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_fd < 0)
+        return FALSE;
+
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = 0;                    /* Any free port */
+    local.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(sock_fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        network_close_udp();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * network_drain_udp - Discard datagrams already queued on the socket
+ *
+ * Late replies to an earlier sync would only fail the origin check,
+ * so they are thrown away before new requests are sent.
+ */
+void network_drain_udp(void)
+{
+    UBYTE buf[NTP_PACKET_SIZE];
+
+    while (network_recv_udp(buf, sizeof(buf), 0, NULL, NULL) >= 0)
+        ;
+}
+
+/*
+ * network_close_udp - Close the UDP socket if open
+ *
+ * Called on errors and from network_cleanup(); the next
+ * network_open_udp() creates a fresh socket.
+ */
+void network_close_udp(void)
+{
     if (sock_fd >= 0) {
         CloseSocket(sock_fd);
         sock_fd = -1;
     }
+}
 
-    /* Create UDP socket */
-    sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock_fd < 0)
-        return FALSE;
+/*
+ * network_udp_is_open - TRUE while the UDP socket exists
+ */
+BOOL network_udp_is_open(void)
+{
+    return (sock_fd >= 0);
+}
 
-    /* Set receive timeout to 5 seconds */
-    tv.tv_sec = 5;
-    tv.tv_usec = 0;
-    setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+/*
+ * network_send_udp - Send a UDP packet
+ *
+ * Sends on the socket opened by network_open_udp(), opening one
+ * first if needed. It can be called once per destination to query
+ * several servers at the same time. A send error closes the socket
+ * so the next sync starts with a fresh one.
+ *
+ * 68000 is big-endian, same as network byte order, so no
+ * byte swapping is needed for port or address values.
+ *
+ * If sent_time is non-NULL it receives the EClock time right after
+ * sendto() returned, as close as we get to the packet leaving.
+ *
+ * Returns TRUE on success, FALSE on failure.
+ */
+BOOL network_send_udp(ULONG ip_addr, UWORD port,
+                      const UBYTE *data, ULONG len, AmigaTime *sent_time)
+{
+    struct sockaddr_in dest;
+    LONG result;
+
+    if (sock_fd < 0 && !network_open_udp())
+        return FALSE;
 
     /* Build destination address */
     memset(&dest, 0, sizeof(dest));
@@ -138,30 +507,40 @@ BOOL network_send_udp(ULONG ip_addr, UWORD port,
     /* Send the packet */
     result = sendto(sock_fd, (UBYTE *)data, len, 0,
                     (struct sockaddr *)&dest, sizeof(dest));
-    if (result < 0 || (ULONG)result != len) {
-        CloseSocket(sock_fd);
-        sock_fd = -1;
+    if (sent_time)
+        clock_get_precise_time(sent_time);
+    if (result < 0) {
+        network_close_udp();
         return FALSE;
     }
+    if ((ULONG)result != len)
+        return FALSE;
 
     return TRUE;
 }
 
 /*
- * network_recv_udp - Receive a UDP packet with timeout
+ * network_recv_udp - Receive one UDP packet with timeout
  *
  * Receives data on the currently open socket (opened by
- * network_send_udp). Uses WaitSelect() for timeout since
+ * network_open_udp). Uses WaitSelect() for timeout since
  * SO_RCVTIMEO is not supported by all Amiga TCP/IP stacks.
+ * The sender's address is stored in *from_ip if non-NULL, and the
+ * EClock time right after recvfrom() returned in *recv_time.
  *
- * The socket is closed after receive (success or failure).
+ * The socket is left open so the caller can keep collecting
+ * replies until its deadline. A timeout of 0 just polls. On a
+ * socket error the socket is closed.
  *
  * Returns number of bytes received, or -1 on error/timeout.
  */
-LONG network_recv_udp(UBYTE *buf, ULONG buf_size, ULONG timeout_secs)
+LONG network_recv_udp(UBYTE *buf, ULONG buf_size, ULONG timeout_ms,
+                      ULONG *from_ip, AmigaTime *recv_time)
 {
     fd_set read_fds;
     struct timeval tv;
+    struct sockaddr_in from;
+    socklen_t from_len;
     ULONG sigmask = 0;  /* No additional signals to wait on */
     LONG select_result;
     LONG result;
@@ -174,30 +553,267 @@ LONG network_recv_udp(UBYTE *buf, ULONG buf_size, ULONG timeout_secs)
     FD_SET(sock_fd, &read_fds);
 
     /* Set timeout */
-    tv.tv_sec = timeout_secs;
-    tv.tv_usec = 0;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
 
     /* Wait for data with timeout using WaitSelect.
      * Pass &sigmask (zero) instead of NULL - some stacks need this.
      */
     select_result = WaitSelect(sock_fd + 1, &read_fds, NULL, NULL, &tv, &sigmask);
 
-    if (select_result <= 0) {
-        /* Timeout (0) or error (-1) */
-        CloseSocket(sock_fd);
-        sock_fd = -1;
+    if (select_result == 0)
+        return -1;  /* Timeout */
+    if (select_result < 0) {
+        network_close_udp();
         return -1;
     }
 
     /* Data is available, receive it */
-    result = recvfrom(sock_fd, buf, buf_size, 0, NULL, NULL);
+    from_len = sizeof(from);
+    result = recvfrom(sock_fd, buf, buf_size, 0,
+                      (struct sockaddr *)&from, &from_len);
+    if (recv_time)
+        clock_get_precise_time(recv_time);
+    if (result < 0) {
+        network_close_udp();
+        return -1;
+    }
 
-    /* Close the socket regardless of result */
-    CloseSocket(sock_fd);
-    sock_fd = -1;
+    if (from_ip)
+        *from_ip = from.sin_addr.s_addr;
+
+    return result;
+}
+
+/*
+ * network_open_listen - Open the socket bound to the NTP port
+ *
+ * Binds a UDP socket to NTP_PORT on every interface, which receives
+ * subnet broadcasts and client requests, and joins the NTP multicast
+ * group 224.0.1.1 if the stack supports IP_ADD_MEMBERSHIP. *joined
+ * tells the caller whether the join worked; broadcasts are received
+ * either way.
+ *
+ * Returns TRUE if the socket is open (also if it already was).
+ */
+BOOL network_open_listen(BOOL *joined)
+{
+    struct sockaddr_in local;
+#ifdef IP_ADD_MEMBERSHIP
+    struct ip_mreq mreq;
+#endif
+    LONG on = 1;
+
+    if (joined)
+        *joined = FALSE;
+    if (listen_fd >= 0)
+        return TRUE;
+
+    if (!network_ensure_open())
+        return FALSE;
+
+    listen_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_fd < 0)
+        return FALSE;
+
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(NTP_PORT);
+    local.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(listen_fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        network_close_listen();
+        return FALSE;
+    }
+
+#ifdef IP_ADD_MEMBERSHIP
+    mreq.imr_multiaddr.s_addr = NTP_MULTICAST_ADDR;
+    mreq.imr_interface.s_addr = INADDR_ANY;
+    if (setsockopt(listen_fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+                   &mreq, sizeof(mreq)) == 0 && joined)
+        *joined = TRUE;
+#endif
+
+    return TRUE;
+}
 
-    if (result < 0)
+/*
+ * network_close_listen - Close the NTP port socket if open
+ */
+void network_close_listen(void)
+{
+    if (listen_fd >= 0) {
+        CloseSocket(listen_fd);
+        listen_fd = -1;
+    }
+}
+
+/*
+ * network_listen_is_open - TRUE while the NTP port socket exists
+ */
+BOOL network_listen_is_open(void)
+{
+    return (listen_fd >= 0);
+}
+
+/*
+ * network_recv_listen - Read one queued packet from the NTP port socket
+ *
+ * Never blocks: network_wait() reports when the socket is readable.
+ * The sender's address and port go to *from_ip and *from_port, the
+ * EClock time right after recvfrom() returned to *recv_time, like
+ * network_recv_udp(). On a socket error the socket is closed;
+ * network_open_listen() makes a new one.
+ *
+ * Returns number of bytes received, or -1 if nothing is queued.
+ */
+LONG network_recv_listen(UBYTE *buf, ULONG buf_size, ULONG *from_ip,
+                         UWORD *from_port, AmigaTime *recv_time)
+{
+    fd_set read_fds;
+    struct timeval tv;
+    struct sockaddr_in from;
+    socklen_t from_len;
+    ULONG sigmask = 0;
+    LONG result;
+
+    if (listen_fd < 0)
+        return -1;
+
+    FD_ZERO(&read_fds);
+    FD_SET(listen_fd, &read_fds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+
+    result = WaitSelect(listen_fd + 1, &read_fds, NULL, NULL, &tv, &sigmask);
+    if (result == 0)
+        return -1;
+    if (result < 0) {
+        network_close_listen();
+        return -1;
+    }
+
+    from_len = sizeof(from);
+    result = recvfrom(listen_fd, buf, buf_size, 0,
+                      (struct sockaddr *)&from, &from_len);
+    if (recv_time)
+        clock_get_precise_time(recv_time);
+    if (result < 0) {
+        network_close_listen();
         return -1;
+    }
+
+    if (from_ip)
+        *from_ip = from.sin_addr.s_addr;
+    if (from_port)
+        *from_port = ntohs(from.sin_port);
 
     return result;
 }
+
+/*
+ * network_send_listen - Send a packet from the NTP port socket
+ *
+ * Used for server replies, which must come from port 123. Unlike
+ * network_send_udp() an error leaves the socket open; one client that
+ * can't be reached shouldn't stop the others being served.
+ *
+ * Returns TRUE if the whole packet was sent.
+ */
+BOOL network_send_listen(ULONG ip_addr, UWORD port,
+                         const UBYTE *data, ULONG len)
+{
+    struct sockaddr_in dest;
+
+    if (listen_fd < 0)
+        return FALSE;
+
+    memset(&dest, 0, sizeof(dest));
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port);
+    dest.sin_addr.s_addr = ip_addr;
+
+    return sendto(listen_fd, (UBYTE *)data, len, 0,
+                  (struct sockaddr *)&dest, sizeof(dest)) == (LONG)len;
+}
+
+/*
+ * network_wait - Wait for signals and, optionally, the sockets
+ *
+ * Replaces Wait() in the event loop. The query socket is only watched
+ * when readable is non-NULL (a sync is waiting for replies), so stray
+ * packets arriving between syncs don't wake the loop; they are
+ * drained before the next send. The broadcast socket is watched when
+ * heard is non-NULL. When watching neither, this is a non-blocking
+ * SetSignal() poll when timeout_ms is 0, a plain Wait(sigmask) when
+ * it is WAIT_FOREVER, and otherwise a WaitSelect() on no sockets so
+ * the timeout still holds. With a socket to watch, WaitSelect()
+ * returns on the signals, a readable socket or the timeout, whichever
+ * comes first, and *readable and *heard tell the caller which sockets
+ * have packets waiting.
+ *
+ * Returns the signals received, like Wait().
+ */
+ULONG network_wait(ULONG sigmask, ULONG timeout_ms, BOOL *readable,
+                   BOOL *heard)
+{
+    fd_set read_fds;
+    struct timeval tv;
+    ULONG sigs;
+    LONG result, nfds = 0;
+    BOOL watch_query, watch_listen;
+
+    if (readable)
+        *readable = FALSE;
+    if (heard)
+        *heard = FALSE;
+
+    watch_query  = (readable != NULL && sock_fd >= 0);
+    watch_listen = (heard != NULL && listen_fd >= 0);
+
+    if (!watch_query && !watch_listen) {
+        if (timeout_ms == 0)
+            return SetSignal(0, sigmask) & sigmask;
+        if (timeout_ms == WAIT_FOREVER || SocketBase == NULL)
+            return Wait(sigmask);
+    }
+
+    FD_ZERO(&read_fds);
+    if (watch_query) {
+        FD_SET(sock_fd, &read_fds);
+        nfds = sock_fd + 1;
+    }
+    if (watch_listen) {
+        FD_SET(listen_fd, &read_fds);
+        if (listen_fd + 1 > nfds)
+            nfds = listen_fd + 1;
+    }
+
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    sigs = sigmask;
+    result = WaitSelect(nfds, &read_fds, NULL, NULL,
+                        (timeout_ms == WAIT_FOREVER) ? NULL : &tv, &sigs);
+
+    if (result > 0) {
+        if (watch_query && FD_ISSET(sock_fd, &read_fds))
+            *readable = TRUE;
+        if (watch_listen && FD_ISSET(listen_fd, &read_fds))
+            *heard = TRUE;
+    } else if (result < 0) {
+        /* Socket error: drop the sockets so nothing spins on them; a
+         * query gives up and the listener is reopened by its owner */
+        if (watch_query) {
+            network_close_udp();
+            *readable = TRUE;
+        }
+        if (watch_listen)
+            network_close_listen();
+        return 0;
+    }
+
+    return sigs & sigmask;
+}
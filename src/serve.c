@@ -0,0 +1,99 @@
+/* serve.c - LAN SNTP server for SyncTime
+ *
+ * With SERVE=1 client requests (mode 3) arriving on the NTP port
+ * socket opened by listen_start() are answered with mode 4 replies
+ * stamped from our own clock, so only one Amiga per site needs to
+ * reach the internet pool and the rest sync at LAN latency.
+ *
+ * A reply describes our clock as the last sync left it: stratum one
+ * more than the upstream server's, that server's address as reference
+ * ID, its round trip as root delay, and a dispersion that grows by
+ * SERVE_PHI_PPM since the sync. Until the first sync, and once no
+ * sync has succeeded for SERVE_STALE_POLLS times MAXINTERVAL, replies
+ * carry the "not synchronized" leap indicator so clients don't
+ * follow us.
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+#define SERVE_PRECISION     -17   /* log2 s; EClock timestamps, about 8us */
+#define SERVE_PHI_PPM       15    /* Dispersion growth, RFC 5905 PHI */
+#define SERVE_BASE_DISP     1000  /* us: our own reading and setting error */
+#define SERVE_STALE_POLLS   3
+#define SERVE_MAX_STRATUM   15
+#define SERVE_UNSYNCED      16    /* Stratum of an unsynchronized server */
+#define SERVE_LI_ALARM      3
+
+static BOOL      synced = FALSE;    /* A sync has succeeded */
+static UBYTE     up_stratum = 0;    /* Stratum of the server we follow */
+static ULONG     up_addr = 0;       /* Its address, our reference ID */
+static LONG      up_delay = 0;      /* Round trip to it, microseconds */
+static AmigaTime ref_time;          /* Clock value set by that sync */
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/*
+ * serve_synced - Note a successful sync for later replies
+ *
+ * stratum is the upstream server's, delay_micro the round trip to it
+ * and when the clock value the sync set.
+ */
+void serve_synced(ULONG ip_addr, UBYTE stratum, LONG delay_micro,
+                  const AmigaTime *when)
+{
+    synced     = TRUE;
+    up_addr    = ip_addr;
+    up_stratum = stratum;
+    up_delay   = (delay_micro > 0) ? delay_micro : 0;
+    ref_time   = *when;
+}
+
+/*
+ * serve_request - Answer one client request
+ *
+ * packet arrived from from_ip:from_port at t2 (local time right after
+ * recvfrom()). Does nothing unless SERVE=1 and the packet is a client
+ * request.
+ */
+void serve_request(const UBYTE *packet, ULONG from_ip, UWORD from_port,
+                   const AmigaTime *t2)
+{
+    SyncConfig *cfg = config_get();
+    UBYTE reply[NTP_PACKET_SIZE];
+    SNTPServerInfo info;
+    AmigaTime t3;
+    ULONG age;
+
+    if (!cfg->serve || (packet[0] & 0x07) != NTP_MODE_CLIENT)
+        return;
+    if (!clock_get_precise_time(&t3))
+        return;
+
+    age = (synced && t3.secs > ref_time.secs) ? t3.secs - ref_time.secs : 0;
+
+    info.precision        = SERVE_PRECISION;
+    info.refid            = up_addr;
+    info.root_delay_micro = (ULONG)up_delay;
+    info.root_disp_micro  = SERVE_BASE_DISP + age * SERVE_PHI_PPM;
+    info.ref_time         = ref_time;
+
+    if (!synced || age > SERVE_STALE_POLLS * (ULONG)cfg->max_interval) {
+        info.leap    = SERVE_LI_ALARM;
+        info.stratum = SERVE_UNSYNCED;
+        info.ref_time.secs = 0;
+    } else {
+        info.leap    = 0;
+        info.stratum = (up_stratum < SERVE_MAX_STRATUM) ? up_stratum + 1
+                                                        : SERVE_MAX_STRATUM;
+    }
+
+    if (sntp_build_reply(reply, packet, &info, tz_find_by_name(cfg->tz_name),
+                         t2, &t3))
+        network_send_listen(from_ip, from_port, reply, NTP_PACKET_SIZE);
+}
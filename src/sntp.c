@@ -1,43 +1,216 @@
 /* sntp.c - SNTP protocol for SyncTime
  *
  * Pure data transformation module: builds NTP request packets,
- * parses NTP response packets, and converts between NTP epoch
- * and AmigaOS epoch timestamps. No I/O, no library calls beyond
- * memset/memcpy.
+ * parses NTP response packets, builds replies for server mode, and
+ * converts between NTP epoch and AmigaOS epoch timestamps. No I/O,
+ * no library calls beyond memset/memcpy.
+ *
+ * Offset and delay follow RFC 4330 section 5:
+ *
+ *   t1 = client transmit time   t2 = server receive time
+ *   t3 = server transmit time   t4 = client receive time
+ *
+ *   offset = ((t2 - t1) + (t3 - t4)) / 2
+ *   delay  = (t4 - t1) - (t3 - t2)
+ *
+ * All arithmetic is done on AmigaTime / ClockOffset pairs so no
+ * 64-bit math is needed on the 68000.
  */
 
 #include "synctime.h"
 
-/* NTP mode values */
-#define NTP_MODE_SERVER    4
-#define NTP_MODE_BROADCAST 5
+/* Leap indicator 3 = server clock not synchronized */
+#define NTP_LI_ALARM       3
+
+/* Longest poll interval a server may ask for: 2^17 s, about 36 hours */
+#define NTP_MAX_POLL       17
+
+/* Kiss codes as big-endian reference IDs */
+#define KISS_ID_RATE       0x52415445UL  /* "RATE" */
+#define KISS_ID_DENY       0x44454E59UL  /* "DENY" */
+#define KISS_ID_RSTR       0x52535452UL  /* "RSTR" */
+
+#define MICROS_PER_SEC     1000000UL
+
+/* Largest delay/offset that fits in a LONG of microseconds */
+#define MAX_MICRO_SECS     2147
+
+/* Extra margin when comparing burst samples: timestamp resolution
+ * and clock reading jitter on our side */
+#define FILTER_SLACK_MICRO 1000
+
+/* =========================================================================
+ * Helpers: byte order and fixed-point conversion
+ * ========================================================================= */
+
+/* Read a big-endian 32-bit value */
+static ULONG get_be32(const UBYTE *p)
+{
+    return ((ULONG)p[0] << 24) |
+           ((ULONG)p[1] << 16) |
+           ((ULONG)p[2] << 8)  |
+           ((ULONG)p[3]);
+}
+
+/* Write a big-endian 32-bit value */
+static void put_be32(UBYTE *p, ULONG v)
+{
+    p[0] = (UBYTE)(v >> 24);
+    p[1] = (UBYTE)(v >> 16);
+    p[2] = (UBYTE)(v >> 8);
+    p[3] = (UBYTE)v;
+}
+
+/* 2^-32 fraction to microseconds: frac * 10^6 / 2^32, computed as
+ * (frac >> 16) * 15625 >> 10 so the product stays within 32 bits. */
+static ULONG frac_to_micro(ULONG frac)
+{
+    return ((frac >> 16) * 15625UL) >> 10;
+}
+
+/* Microseconds to 2^-32 fraction (inverse of frac_to_micro) */
+static ULONG micro_to_frac(ULONG micro)
+{
+    return ((micro << 10) / 15625UL) << 16;
+}
+
+/* Encode a local Amiga time as an NTP timestamp for the transmit field.
+ * The server only echoes it back in the origin field, so there is no
+ * need to convert to UTC; keeping it local means t1 needs no timezone
+ * lookup and compares exactly against what we sent. */
+static void encode_time(const AmigaTime *t, NTPTimestamp *ts)
+{
+    ts->secs = t->secs + NTP_TO_AMIGA_EPOCH;
+    ts->frac = micro_to_frac(t->micro);
+}
+
+/* Encode a local Amiga time as a UTC NTP timestamp, for our replies */
+static void encode_utc(const AmigaTime *t, const TZEntry *tz, UBYTE *p)
+{
+    put_be32(p, sntp_amiga_to_ntp(t->secs, tz));
+    put_be32(p + 4, micro_to_frac(t->micro));
+}
+
+/* Microseconds to the 16.16 fixed-point "NTP short" format; a ULONG
+ * of microseconds is at most 4294 s, so the seconds always fit */
+static ULONG micro_to_short(ULONG micro)
+{
+    return ((micro / MICROS_PER_SEC) << 16) |
+           ((micro % MICROS_PER_SEC) * 4096UL / 62500UL);
+}
+
+/* Convert a server (UTC) NTP timestamp to local Amiga time */
+static void decode_time(const NTPTimestamp *ts, const TZEntry *tz,
+                        AmigaTime *t)
+{
+    t->secs  = sntp_ntp_to_amiga(ts->secs, tz);
+    t->micro = frac_to_micro(ts->frac);
+}
+
+/* =========================================================================
+ * Helpers: ClockOffset arithmetic
+ * ========================================================================= */
+
+/* out = a - b */
+static void time_diff(const AmigaTime *a, const AmigaTime *b, ClockOffset *out)
+{
+    out->secs = (LONG)(a->secs - b->secs);
+    if (a->micro >= b->micro) {
+        out->micro = a->micro - b->micro;
+    } else {
+        out->micro = a->micro + MICROS_PER_SEC - b->micro;
+        out->secs--;
+    }
+}
+
+/* acc += b */
+static void offset_add(ClockOffset *acc, const ClockOffset *b)
+{
+    acc->secs  += b->secs;
+    acc->micro += b->micro;
+    if (acc->micro >= MICROS_PER_SEC) {
+        acc->micro -= MICROS_PER_SEC;
+        acc->secs++;
+    }
+}
+
+/* acc -= b */
+static void offset_sub(ClockOffset *acc, const ClockOffset *b)
+{
+    acc->secs -= b->secs;
+    if (acc->micro >= b->micro) {
+        acc->micro -= b->micro;
+    } else {
+        acc->micro = acc->micro + MICROS_PER_SEC - b->micro;
+        acc->secs--;
+    }
+}
+
+/* o = o / 2, rounding toward negative infinity */
+static void offset_half(ClockOffset *o)
+{
+    if (o->secs & 1) {
+        o->secs--;
+        o->micro += MICROS_PER_SEC;
+    }
+    o->secs  /= 2;
+    o->micro /= 2;
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
 
 /*
  * sntp_build_request - Build an SNTP client request packet
  *
- * Zeroes all 48 bytes and sets the LI/Version/Mode byte to
- * indicate NTPv3 client mode (0x1B).
+ * Zeroes all 48 bytes, sets the LI/Version/Mode byte to indicate
+ * NTPv3 client mode (0x1B), and stamps t1 into the transmit
+ * timestamp (bytes 40-47) so the server echoes it back as origin.
  */
-void sntp_build_request(UBYTE *packet)
+void sntp_build_request(UBYTE *packet, const AmigaTime *t1)
 {
+    NTPTimestamp ts;
+
     memset(packet, 0, NTP_PACKET_SIZE);
     packet[0] = (NTP_VERSION << 3) | NTP_MODE_CLIENT;  /* 0x1B */
+
+    encode_time(t1, &ts);
+    put_be32(packet + 40, ts.secs);
+    put_be32(packet + 44, ts.frac);
+}
+
+/* Helper: copy the header fields and timestamps out of a packet */
+static void read_fields(const UBYTE *packet, SNTPResponse *resp)
+{
+    resp->mode    = packet[0] & 0x07;
+    resp->stratum = packet[1];
+    resp->poll    = (BYTE)packet[2];
+    resp->refid   = get_be32(packet + 12);
+
+    resp->origin.secs   = get_be32(packet + 24);
+    resp->origin.frac   = get_be32(packet + 28);
+    resp->receive.secs  = get_be32(packet + 32);
+    resp->receive.frac  = get_be32(packet + 36);
+    resp->transmit.secs = get_be32(packet + 40);
+    resp->transmit.frac = get_be32(packet + 44);
 }
 
 /*
  * sntp_parse_response - Parse an SNTP server response packet
  *
- * Validates the response mode and stratum, then extracts the
- * transmit timestamp (bytes 40-47) as big-endian 32-bit values.
+ * Validates the response mode, leap indicator and stratum, then
+ * extracts the poll field, reference ID (bytes 12-15), and the
+ * originate (bytes 24-31), receive (bytes 32-39) and transmit
+ * (bytes 40-47) timestamps as big-endian 32-bit values.
  *
- * Returns TRUE on success, FALSE if the packet is invalid.
+ * Returns TRUE on success, FALSE if the packet is invalid. A
+ * Kiss-of-Death is invalid here; see sntp_parse_kiss().
  */
-BOOL sntp_parse_response(const UBYTE *packet, ULONG *ntp_secs, ULONG *ntp_frac)
+BOOL sntp_parse_response(const UBYTE *packet, SNTPResponse *resp)
 {
     UBYTE mode;
     UBYTE stratum;
-    ULONG secs;
-    ULONG frac;
 
     /* Extract mode from byte 0, bits 0-2 */
     mode = packet[0] & 0x07;
@@ -46,32 +219,280 @@ BOOL sntp_parse_response(const UBYTE *packet, ULONG *ntp_secs, ULONG *ntp_frac)
     if (mode != NTP_MODE_SERVER && mode != NTP_MODE_BROADCAST)
         return FALSE;
 
+    /* Leap indicator in bits 6-7: alarm means the server is unsynchronized */
+    if ((packet[0] >> 6) == NTP_LI_ALARM)
+        return FALSE;
+
     /* Stratum 0 is kiss-of-death */
     stratum = packet[1];
     if (stratum == 0)
         return FALSE;
 
-    /* Extract transmit timestamp seconds (bytes 40-43, big-endian) */
-    secs = ((ULONG)packet[40] << 24) |
-           ((ULONG)packet[41] << 16) |
-           ((ULONG)packet[42] << 8)  |
-           ((ULONG)packet[43]);
-
-    /* Extract transmit timestamp fraction (bytes 44-47, big-endian) */
-    frac = ((ULONG)packet[44] << 24) |
-           ((ULONG)packet[45] << 16) |
-           ((ULONG)packet[46] << 8)  |
-           ((ULONG)packet[47]);
+    read_fields(packet, resp);
 
     /* Server didn't set a transmit timestamp */
-    if (secs == 0)
+    if (resp->transmit.secs == 0)
+        return FALSE;
+
+    return TRUE;
+}
+
+/*
+ * sntp_build_reply - Build a server reply to a client request
+ *
+ * The counterpart of sntp_build_request() for server mode. Only
+ * client requests (mode 3) are answered. The reply is mode 4 with the
+ * client's version (3 if it sent something odd) and poll, our stratum,
+ * precision, root delay and dispersion, the upstream server as
+ * reference ID, the request's transmit timestamp as origin, and t2
+ * (when the request arrived) and t3 (now) as UTC timestamps.
+ *
+ * Returns FALSE, leaving reply alone, if request isn't a client
+ * request.
+ */
+BOOL sntp_build_reply(UBYTE *reply, const UBYTE *request,
+                      const SNTPServerInfo *info, const TZEntry *tz,
+                      const AmigaTime *t2, const AmigaTime *t3)
+{
+    UBYTE version = (request[0] >> 3) & 0x07;
+
+    if ((request[0] & 0x07) != NTP_MODE_CLIENT)
         return FALSE;
+    if (version < 1 || version > 4)
+        version = NTP_VERSION;
+
+    memset(reply, 0, NTP_PACKET_SIZE);
+    reply[0] = (UBYTE)((info->leap << 6) | (version << 3) | NTP_MODE_SERVER);
+    reply[1] = info->stratum;
+    reply[2] = request[2];
+    reply[3] = (UBYTE)info->precision;
+    put_be32(reply + 4, micro_to_short(info->root_delay_micro));
+    put_be32(reply + 8, micro_to_short(info->root_disp_micro));
+    put_be32(reply + 12, info->refid);
+
+    if (info->ref_time.secs != 0)
+        encode_utc(&info->ref_time, tz, reply + 16);
+    memcpy(reply + 24, request + 40, 8);
+    encode_utc(t2, tz, reply + 32);
+    encode_utc(t3, tz, reply + 40);
 
-    *ntp_secs = secs;
-    *ntp_frac = frac;
     return TRUE;
 }
 
+/*
+ * sntp_parse_kiss - Decode a Kiss-of-Death packet
+ *
+ * A server reply (mode 4) with stratum 0 carries a four-letter kiss
+ * code in the reference ID (RFC 5905 section 7.4). RATE, DENY and
+ * RSTR are decoded, anything else is KISS_OTHER. resp is filled in
+ * as by sntp_parse_response(); the transmit timestamp may be zero,
+ * so check the origin with sntp_matches_request() before believing
+ * it.
+ *
+ * Returns the KISS_* code, KISS_NONE if the packet isn't a kiss.
+ */
+UBYTE sntp_parse_kiss(const UBYTE *packet, SNTPResponse *resp)
+{
+    if ((packet[0] & 0x07) != NTP_MODE_SERVER || packet[1] != 0)
+        return KISS_NONE;
+
+    read_fields(packet, resp);
+
+    switch (resp->refid) {
+        case KISS_ID_RATE: return KISS_RATE;
+        case KISS_ID_DENY: return KISS_DENY;
+        case KISS_ID_RSTR: return KISS_RSTR;
+    }
+    return KISS_OTHER;
+}
+
+/*
+ * sntp_matches_request - TRUE if a reply echoes the request stamped t1
+ *
+ * The origin timestamp must match exactly, otherwise the reply is
+ * stale or spoofed.
+ */
+BOOL sntp_matches_request(const SNTPResponse *resp, const AmigaTime *t1)
+{
+    NTPTimestamp stamped;
+
+    encode_time(t1, &stamped);
+    return (resp->origin.secs == stamped.secs &&
+            resp->origin.frac == stamped.frac);
+}
+
+/*
+ * sntp_poll_secs - Poll interval the server asked for, in seconds
+ *
+ * The poll field is a log2 exponent. 0 if the server gave none, at
+ * most 2^NTP_MAX_POLL.
+ */
+ULONG sntp_poll_secs(const SNTPResponse *resp)
+{
+    if (resp->poll <= 0)
+        return 0;
+    if (resp->poll > NTP_MAX_POLL)
+        return 1UL << NTP_MAX_POLL;
+    return 1UL << resp->poll;
+}
+
+/*
+ * sntp_compute_sample - Compute clock offset and round-trip delay
+ *
+ * t1 is the local time stamped into the request, sent the local time
+ * it actually went out and t4 the local time the response arrived.
+ * The response's origin timestamp must match t1 exactly, otherwise it
+ * is a stale or spoofed reply; the offset and delay use sent, which
+ * leaves out the time spent building and handing over the request.
+ * A server that left the receive timestamp empty is treated as
+ * t2 == t3.
+ *
+ * Returns TRUE on success, FALSE if the response doesn't belong to
+ * this request.
+ */
+BOOL sntp_compute_sample(const SNTPResponse *resp, const AmigaTime *t1,
+                         const AmigaTime *sent, const AmigaTime *t4,
+                         const TZEntry *tz, SNTPSample *sample)
+{
+    AmigaTime t2, t3;
+    ClockOffset d, rtt;
+
+    if (!sntp_matches_request(resp, t1))
+        return FALSE;
+
+    decode_time(&resp->transmit, tz, &t3);
+    if (resp->receive.secs != 0)
+        decode_time(&resp->receive, tz, &t2);
+    else
+        t2 = t3;
+
+    /* offset = ((t2 - t1) + (t3 - t4)) / 2 */
+    time_diff(&t2, sent, &sample->offset);
+    time_diff(&t3, t4, &d);
+    offset_add(&sample->offset, &d);
+    offset_half(&sample->offset);
+
+    /* delay = (t4 - t1) - (t3 - t2) */
+    time_diff(t4, sent, &rtt);
+    time_diff(&t3, &t2, &d);
+    offset_sub(&rtt, &d);
+    sample->delay_micro = sntp_offset_to_micro(&rtt);
+    if (sample->delay_micro < 0)
+        sample->delay_micro = 0;  /* Server processing exceeded our tick */
+
+    sample->stratum = resp->stratum;
+    return TRUE;
+}
+
+/*
+ * sntp_compute_broadcast - Clock offset from a broadcast packet
+ *
+ * A broadcast has no request to time, so the one-way delay from the
+ * server has to be supplied (measured by a calibration exchange, or
+ * configured):
+ *
+ *   offset = (t3 + one_way) - t4
+ *
+ * The sample's delay is reported as twice one_way, the round trip it
+ * stands for, so sntp_filter_samples() weighs it like a reply.
+ */
+void sntp_compute_broadcast(const SNTPResponse *resp, const AmigaTime *t4,
+                            LONG one_way_micro, const TZEntry *tz,
+                            SNTPSample *sample)
+{
+    AmigaTime t3;
+    ClockOffset d;
+
+    decode_time(&resp->transmit, tz, &t3);
+    time_diff(&t3, t4, &sample->offset);
+
+    if (one_way_micro < 0)
+        one_way_micro = 0;
+    d.secs  = one_way_micro / (LONG)MICROS_PER_SEC;
+    d.micro = (ULONG)(one_way_micro % (LONG)MICROS_PER_SEC);
+    offset_add(&sample->offset, &d);
+
+    sample->delay_micro = (one_way_micro > 0x3FFFFFFFL) ? 0x7FFFFFFFL
+                                                        : one_way_micro * 2;
+    sample->stratum = resp->stratum;
+}
+
+/*
+ * sntp_offset_to_micro - Convert an offset to signed microseconds
+ *
+ * Clamped to what fits in a LONG (about +/-2147 seconds).
+ */
+LONG sntp_offset_to_micro(const ClockOffset *offset)
+{
+    if (offset->secs >= MAX_MICRO_SECS)
+        return 0x7FFFFFFFL;
+    if (offset->secs < -MAX_MICRO_SECS)
+        return -0x7FFFFFFFL;
+    return offset->secs * (LONG)MICROS_PER_SEC + (LONG)offset->micro;
+}
+
+/*
+ * sntp_filter_samples - Pick the sample to trust from a burst
+ *
+ * A sample's offset is only known to within half its round-trip
+ * delay, because the two legs can be queued unequally. Two samples
+ * agree if those error bounds overlap (plus FILTER_SLACK_MICRO). The
+ * result is the lowest-delay sample that agrees with a majority of
+ * the burst, so a fast but wrong reply is rejected as well as a slow
+ * one. If none has a majority, e.g. two samples that disagree, the
+ * lowest-delay sample is used.
+ *
+ * Returns how many samples agree with the chosen one, itself
+ * included; the other count - n were rejected as outliers. Returns
+ * 0 and leaves best alone if count is 0. At most MAX_BURST samples
+ * are considered.
+ */
+LONG sntp_filter_samples(const SNTPSample *samples, LONG count,
+                         SNTPSample *best)
+{
+    LONG offsets[MAX_BURST];
+    LONG agree[MAX_BURST];
+    LONG i, j, pick, fast;
+    ULONG diff, bound;
+
+    if (count > MAX_BURST)
+        count = MAX_BURST;
+    if (count <= 0)
+        return 0;
+
+    for (i = 0; i < count; i++)
+        offsets[i] = sntp_offset_to_micro(&samples[i].offset);
+
+    pick = -1;
+    fast = 0;
+    for (i = 0; i < count; i++) {
+        agree[i] = 0;
+        for (j = 0; j < count; j++) {
+            /* Unsigned difference can't overflow for two LONGs */
+            if (offsets[i] >= offsets[j])
+                diff = (ULONG)offsets[i] - (ULONG)offsets[j];
+            else
+                diff = (ULONG)offsets[j] - (ULONG)offsets[i];
+            bound = (ULONG)samples[i].delay_micro / 2 +
+                    (ULONG)samples[j].delay_micro / 2 + FILTER_SLACK_MICRO;
+            if (diff <= bound)
+                agree[i]++;
+        }
+
+        if (samples[i].delay_micro < samples[fast].delay_micro)
+            fast = i;
+        if (agree[i] * 2 > count &&
+            (pick < 0 || samples[i].delay_micro < samples[pick].delay_micro))
+            pick = i;
+    }
+
+    if (pick < 0)
+        pick = fast;
+
+    *best = samples[pick];
+    return agree[pick];
+}
+
 /*
  * sntp_ntp_to_amiga - Convert NTP timestamp to Amiga local time
  *
@@ -93,3 +514,21 @@ ULONG sntp_ntp_to_amiga(ULONG ntp_secs, const TZEntry *tz)
     /* Apply offset (can be negative for western timezones) */
     return (ULONG)((LONG)utc_secs + (offset_mins * 60));
 }
+
+/*
+ * sntp_amiga_to_ntp - Convert Amiga local time to an NTP timestamp
+ *
+ * Inverse of sntp_ntp_to_amiga(). The offset is looked up twice,
+ * first with the local time standing in for UTC, then with the UTC
+ * time that gives, so times near a DST change come out right apart
+ * from the skipped or repeated hour itself.
+ */
+ULONG sntp_amiga_to_ntp(ULONG amiga_secs, const TZEntry *tz)
+{
+    ULONG utc_secs;
+
+    utc_secs = (ULONG)((LONG)amiga_secs - tz_get_offset_mins(tz, amiga_secs) * 60);
+    utc_secs = (ULONG)((LONG)amiga_secs - tz_get_offset_mins(tz, utc_secs) * 60);
+
+    return utc_secs + NTP_TO_AMIGA_EPOCH;
+}
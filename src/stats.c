@@ -0,0 +1,257 @@
+/* stats.c - Sync statistics for SyncTime
+ *
+ * Keeps rolling min/avg/max over the last STATS_WINDOW values and a
+ * running histogram for DNS lookup time, round-trip delay, measured
+ * offset and failure streaks, plus sync totals.
+ *
+ * After every sync the figures are exported as the global variable
+ * ENV:SyncTimeStats, one KEY=value per line like the prefs file:
+ *
+ *   SYNCS=12            total finished syncs
+ *   OK=11               successful ones
+ *   FAILSTREAK=0        current run of failed syncs
+ *   DNS=4,12,40         ms, min,avg,max of the last STATS_WINDOW lookups
+ *   RTT=20,31,58        ms, round-trip delay
+ *   OFFSET=-3,1,9       ms, measured offset before correction
+ *   STREAK=1,1,2        length of failure runs that have ended
+ *   DNSHIST=a,b,...     counts per bin since startup (see below)
+ *   RTTHIST=...
+ *   OFFSETHIST=...      by magnitude
+ *   STREAKHIST=...
+ *
+ * Time histogram bins are <10, <25, <50, <100, <250, <500, <1000 and
+ * >=1000 ms; streak bins are 1, 2, 3-4, 5-9, 10-19, 20-49, 50-99, 100+.
+ * Metrics without values are exported as "-".
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+#define STATS_WINDOW   16
+#define STATS_BINS     8
+#define STATS_VAR      "SyncTimeStats"
+
+typedef struct {
+    LONG        ring[STATS_WINDOW];  /* Last values, oldest overwritten */
+    UWORD       next;
+    UWORD       count;
+    ULONG       hist[STATS_BINS];
+    const LONG *edges;               /* STATS_BINS - 1 upper bounds */
+} StatMetric;
+
+static const LONG time_edges[STATS_BINS - 1]   = { 10, 25, 50, 100, 250, 500, 1000 };
+static const LONG streak_edges[STATS_BINS - 1] = { 2, 3, 5, 10, 20, 50, 100 };
+
+static StatMetric dns_stat    = { {0}, 0, 0, {0}, time_edges };
+static StatMetric rtt_stat    = { {0}, 0, 0, {0}, time_edges };
+static StatMetric offset_stat = { {0}, 0, 0, {0}, time_edges };
+static StatMetric streak_stat = { {0}, 0, 0, {0}, streak_edges };
+
+static ULONG total_syncs = 0;
+static ULONG ok_syncs    = 0;
+static ULONG fail_streak = 0;
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+/* Add one value to a metric's ring and histogram */
+static void metric_add(StatMetric *m, LONG value)
+{
+    LONG mag = value < 0 ? -value : value;
+    LONG bin;
+
+    m->ring[m->next] = value;
+    m->next = (m->next + 1) % STATS_WINDOW;
+    if (m->count < STATS_WINDOW)
+        m->count++;
+
+    for (bin = 0; bin < STATS_BINS - 1 && mag >= m->edges[bin]; bin++)
+        ;
+    m->hist[bin]++;
+}
+
+/* Min, average and max over the ring; FALSE if it's empty */
+static BOOL metric_range(const StatMetric *m, LONG *min, LONG *avg, LONG *max)
+{
+    LONG sum, i;
+
+    if (m->count == 0)
+        return FALSE;
+
+    *min = *max = sum = m->ring[0];
+    for (i = 1; i < m->count; i++) {
+        if (m->ring[i] < *min) *min = m->ring[i];
+        if (m->ring[i] > *max) *max = m->ring[i];
+        sum += m->ring[i];
+    }
+    *avg = sum / m->count;
+    return TRUE;
+}
+
+/* Helper to append a signed decimal number */
+static char *append_num(char *p, LONG val)
+{
+    char tmp[12];
+    ULONG uval;
+    int i = 0;
+
+    if (val < 0) {
+        *p++ = '-';
+        uval = (ULONG)(-(val + 1)) + 1;
+    } else {
+        uval = (ULONG)val;
+    }
+
+    do {
+        tmp[i++] = '0' + (char)(uval % 10);
+        uval /= 10;
+    } while (uval > 0);
+
+    while (i > 0)
+        *p++ = tmp[--i];
+
+    return p;
+}
+
+/* Helper to append a string */
+static char *append_str(char *p, const char *s)
+{
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+/* Helper to append "KEY=min,avg,max\n" (or "KEY=-\n") */
+static char *append_range(char *p, const char *key, const StatMetric *m)
+{
+    LONG min, avg, max;
+
+    p = append_str(p, key);
+    *p++ = '=';
+    if (metric_range(m, &min, &avg, &max)) {
+        p = append_num(p, min);
+        *p++ = ',';
+        p = append_num(p, avg);
+        *p++ = ',';
+        p = append_num(p, max);
+    } else {
+        *p++ = '-';
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/* Helper to append "KEY=b0,b1,...\n" */
+static char *append_hist(char *p, const char *key, const StatMetric *m)
+{
+    LONG i;
+
+    p = append_str(p, key);
+    *p++ = '=';
+    for (i = 0; i < STATS_BINS; i++) {
+        if (i > 0)
+            *p++ = ',';
+        p = append_num(p, (LONG)m->hist[i]);
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/* stats_record_dns: time spent resolving the server names, in ms */
+void stats_record_dns(ULONG ms)
+{
+    metric_add(&dns_stat, (LONG)(ms > 0x7FFFFFFFUL ? 0x7FFFFFFFUL : ms));
+}
+
+/* stats_record_sample: offset and delay of the reply that was used */
+void stats_record_sample(LONG offset_micro, LONG delay_micro)
+{
+    metric_add(&offset_stat, offset_micro / 1000);
+    metric_add(&rtt_stat, delay_micro / 1000);
+}
+
+/* stats_record_result: outcome of a finished sync */
+void stats_record_result(BOOL ok)
+{
+    total_syncs++;
+    if (ok) {
+        ok_syncs++;
+        if (fail_streak > 0)
+            metric_add(&streak_stat, (LONG)fail_streak);
+        fail_streak = 0;
+    } else {
+        fail_streak++;
+    }
+}
+
+/*
+ * stats_format - One-line summary for the window
+ *
+ * "11/12 ok, RTT 31 ms, offset 1 ms" using the rolling averages.
+ * buf must hold at least 64 bytes.
+ */
+void stats_format(char *buf)
+{
+    LONG min, avg, max;
+    char *p = buf;
+
+    if (total_syncs == 0) {
+        strcpy(buf, "No syncs yet");
+        return;
+    }
+
+    p = append_num(p, (LONG)ok_syncs);
+    *p++ = '/';
+    p = append_num(p, (LONG)total_syncs);
+    p = append_str(p, " ok");
+    if (metric_range(&rtt_stat, &min, &avg, &max)) {
+        p = append_str(p, ", RTT ");
+        p = append_num(p, avg);
+        p = append_str(p, " ms");
+    }
+    if (metric_range(&offset_stat, &min, &avg, &max)) {
+        p = append_str(p, ", offset ");
+        p = append_num(p, avg);
+        p = append_str(p, " ms");
+    }
+    *p = '\0';
+}
+
+/*
+ * stats_export - Publish the statistics as ENV:SyncTimeStats
+ *
+ * ENV: only (GVF_GLOBAL_ONLY without GVF_SAVE_VAR), so updating it
+ * after every sync never touches the boot volume.
+ */
+void stats_export(void)
+{
+    char buf[768];
+    char *p = buf;
+
+    p = append_str(p, "SYNCS=");
+    p = append_num(p, (LONG)total_syncs);
+    p = append_str(p, "\nOK=");
+    p = append_num(p, (LONG)ok_syncs);
+    p = append_str(p, "\nFAILSTREAK=");
+    p = append_num(p, (LONG)fail_streak);
+    *p++ = '\n';
+    p = append_range(p, "DNS", &dns_stat);
+    p = append_range(p, "RTT", &rtt_stat);
+    p = append_range(p, "OFFSET", &offset_stat);
+    p = append_range(p, "STREAK", &streak_stat);
+    p = append_hist(p, "DNSHIST", &dns_stat);
+    p = append_hist(p, "RTTHIST", &rtt_stat);
+    p = append_hist(p, "OFFSETHIST", &offset_stat);
+    p = append_hist(p, "STREAKHIST", &streak_stat);
+    *p = '\0';
+
+    SetVar(STATS_VAR, buf, p - buf, GVF_GLOBAL_ONLY);
+}
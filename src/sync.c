@@ -0,0 +1,802 @@
+/* sync.c - Incremental SNTP sync state machine for SyncTime
+ *
+ * A sync runs as a sequence of short steps driven from event_loop():
+ *
+ *   RESOLVE -> SEND -> AWAIT -> APPLY
+ *
+ * Every step returns to the event loop, so gadget, hotkey and Exchange
+ * messages are handled between them. While waiting for replies the
+ * socket is folded into the main wait via network_wait(), which calls
+ * WaitSelect() with the commodity's signal mask.
+ *
+ * With BURST=n above 1, SEND and AWAIT repeat n times, BURST_SPACING_MS
+ * apart, and each address's samples go through sntp_filter_samples()
+ * before the best address is picked.
+ *
+ * A Kiss-of-Death stops queries to that address and hands it to
+ * network_kiss_address(), which keeps it out of later syncs for a
+ * while. sync_hold_secs() then tells main.c how long the servers
+ * asked us to stay away.
+ */
+
+#include "synctime.h"
+
+/* =========================================================================
+ * Static module state
+ * ========================================================================= */
+
+#define SYNC_STATE_IDLE    0
+#define SYNC_STATE_RESOLVE 1
+#define SYNC_STATE_SEND    2
+#define SYNC_STATE_AWAIT   3
+#define SYNC_STATE_APPLY   4
+
+/* One address of a multi-address query */
+typedef struct {
+    ULONG      ip_addr;
+    AmigaTime  t1;         /* Local time stamped into the current request */
+    AmigaTime  sent;       /* Local time sendto() returned */
+    BOOL       pending;    /* Current request sent and not yet answered */
+    UBYTE      kiss;       /* KISS_* received this sync */
+    ULONG      poll_secs;  /* Poll interval asked for by the last reply */
+    UBYTE      sample_count;
+    SNTPSample samples[MAX_BURST];  /* One per answered request */
+    SNTPSample sample;     /* Filtered result */
+} QuerySlot;
+
+static QuerySlot query_slots[MAX_SERVER_ADDRS];
+
+static int        sync_state = SYNC_STATE_IDLE;
+static const TZEntry *sync_tz = NULL;
+static LONG       slot_count = 0;    /* Addresses resolved */
+static LONG       sent_count = 0;    /* Requests sent this round */
+static LONG       answer_count = 0;  /* Valid replies matched this round */
+static LONG       burst_rounds = 1;  /* Rounds of requests this sync */
+static LONG       burst_round = 0;   /* Current round, 0-based */
+static QuerySlot *best_slot = NULL;  /* Lowest-delay filtered sample */
+static AmigaTime  send_time;         /* When this round's first request went out */
+static ULONG      hold_secs = 0;     /* Shortest wait the servers asked for */
+
+/* Result of the last finished sync */
+static char       result_text[32] = "Idle";
+static AmigaTime  result_time;
+static ULONG      result_addr = 0;   /* Server of the last applied sample */
+static LONG       result_delay = 0;  /* Its round-trip delay, microseconds */
+static UBYTE      result_stratum = 0; /* Its stratum */
+
+/* =========================================================================
+ * Formatting helpers
+ * ========================================================================= */
+
+/* Helper to format IP address into buffer */
+static void format_ip(ULONG ip_addr, char *buf)
+{
+    UBYTE *ip = (UBYTE *)&ip_addr;
+    int i, val, pos = 0;
+
+    for (i = 0; i < 4; i++) {
+        val = ip[i];
+        if (val >= 100) { buf[pos++] = '0' + (val / 100); val %= 100; }
+        if (val >= 10 || ip[i] >= 100) { buf[pos++] = '0' + (val / 10); val %= 10; }
+        buf[pos++] = '0' + val;
+        if (i < 3) buf[pos++] = '.';
+    }
+    buf[pos] = '\0';
+}
+
+/* Helper to append an unsigned decimal number, zero-padded to min_digits */
+static char *append_uint(char *p, ULONG val, int min_digits)
+{
+    char tmp[12];
+    int i = 0;
+
+    do {
+        tmp[i++] = '0' + (char)(val % 10);
+        val /= 10;
+    } while (val > 0 || i < min_digits);
+
+    while (i > 0)
+        *p++ = tmp[--i];
+
+    return p;
+}
+
+/* Helper to format a clock offset as "+S.mmm s" into buffer */
+static void format_offset(const ClockOffset *offset, char *buf)
+{
+    ULONG secs, micro;
+    char *p = buf;
+
+    /* offset->micro is a positive fraction on top of a floored secs value */
+    if (offset->secs < 0) {
+        *p++ = '-';
+        secs  = (ULONG)(-(offset->secs + 1));
+        micro = 1000000UL - offset->micro;
+        if (micro == 1000000UL) {
+            secs++;
+            micro = 0;
+        }
+    } else {
+        *p++ = '+';
+        secs  = (ULONG)offset->secs;
+        micro = offset->micro;
+    }
+
+    p = append_uint(p, secs, 1);
+    *p++ = '.';
+    p = append_uint(p, micro / 1000, 3);
+    strcpy(p, " s");
+}
+
+/* Helper to log the drift estimate as "+P.ppp ppm" and the next poll */
+static void log_drift(void)
+{
+    char msg[64];
+    char *p;
+    LONG ppb;
+    ULONG mag;
+
+    if (!log_enabled(LOG_INFO) || !drift_freq_ppb(&ppb))
+        return;
+
+    strcpy(msg, "Clock drift ");
+    p = msg + 12;
+    *p++ = ppb < 0 ? '-' : '+';
+    mag = (ULONG)(ppb < 0 ? -ppb : ppb);
+    p = append_uint(p, mag / 1000, 1);
+    *p++ = '.';
+    p = append_uint(p, mag % 1000, 3);
+    strcpy(p, " ppm, next sync in ");
+    p += 19;
+    p = append_uint(p, drift_poll_interval(), 1);
+    strcpy(p, " s");
+    log_msg(LOG_INFO, msg);
+}
+
+/* Helper to log a Kiss-of-Death as "WARNING: RATE from a.b.c.d" */
+static void log_kiss(UBYTE kiss, ULONG ip_addr, ULONG hold)
+{
+    static const char *const names[] = { "", "RATE", "DENY", "RSTR", "Kiss" };
+    char msg[64];
+    char *p;
+
+    if (!log_enabled(LOG_WARN))
+        return;
+
+    strcpy(msg, "WARNING: ");
+    strcpy(msg + 9, names[kiss]);
+    p = msg + strlen(msg);
+    strcpy(p, " from ");
+    format_ip(ip_addr, p + 6);
+    if (hold > 0) {
+        p += strlen(p);
+        strcpy(p, ", holding ");
+        p = append_uint(p + 10, hold, 1);
+        strcpy(p, " s");
+    }
+    log_msg(LOG_WARN, msg);
+}
+
+/* Helper to compute milliseconds elapsed between two clock readings */
+static ULONG elapsed_ms(const AmigaTime *from, const AmigaTime *to)
+{
+    ULONG secs, micro;
+
+    if (to->secs < from->secs ||
+        (to->secs == from->secs && to->micro < from->micro))
+        return 0;  /* Clock went backwards */
+
+    secs = to->secs - from->secs;
+    if (to->micro >= from->micro) {
+        micro = to->micro - from->micro;
+    } else {
+        micro = to->micro + 1000000UL - from->micro;
+        secs--;
+    }
+
+    if (secs > 1000000UL)
+        return 0xFFFFFFFFUL;
+    return secs * 1000 + micro / 1000;
+}
+
+/* =========================================================================
+ * State transitions
+ * ========================================================================= */
+
+/* Finish the sync with the given status; text is shown in the window */
+static LONG sync_finish(LONG status, const char *text)
+{
+    LONG i;
+
+    for (i = 0; i < (LONG)sizeof(result_text) - 1 && text[i] != '\0'; i++)
+        result_text[i] = text[i];
+    result_text[i] = '\0';
+
+    /* An abort is neither a success nor a failure */
+    if (status != STATUS_IDLE)
+        stats_record_result(status == STATUS_OK);
+
+    sync_state = SYNC_STATE_IDLE;
+    return status;
+}
+
+/*
+ * step_resolve - Resolve every hostname in the server setting
+ *
+ * The server field may list several hostnames separated by spaces
+ * or commas. All addresses of each host are collected (duplicates
+ * dropped) into query_slots, up to MAX_SERVER_ADDRS.
+ */
+static LONG step_resolve(void)
+{
+    const char *servers = config_get()->server;
+    ULONG addrs[MAX_SERVER_ADDRS];
+    char host[SERVER_NAME_MAX];
+    char msg[64];
+    LONG found, i, j, len, level;
+    BOOL cached, looked_up;
+    AmigaTime start, end;
+    ULONG held, min_held;
+    char *p;
+
+    slot_count = 0;
+    looked_up = FALSE;
+    min_held = 0;
+    clock_get_precise_time(&start);
+
+    while (*servers && slot_count < MAX_SERVER_ADDRS) {
+        /* Skip separators */
+        while (*servers == ' ' || *servers == ',' || *servers == '\t')
+            servers++;
+        if (*servers == '\0')
+            break;
+
+        /* Copy one hostname */
+        for (len = 0; servers[len] && servers[len] != ' ' &&
+                      servers[len] != ',' && servers[len] != '\t' &&
+                      len < SERVER_NAME_MAX - 1; len++)
+            host[len] = servers[len];
+        host[len] = '\0';
+        servers += len;
+
+        found = network_resolve_all(host, addrs, MAX_SERVER_ADDRS, &cached,
+                                    &held);
+        if (!cached)
+            looked_up = TRUE;
+        if (found == 0 && held > 0 && (min_held == 0 || held < min_held))
+            min_held = held;
+
+        level = (found == 0) ? LOG_WARN : LOG_DEBUG;
+        if (log_enabled(level)) {
+            if (found == 0 && held > 0)
+                strcpy(msg, "WARNING: Asked to back off by ");
+            else if (found == 0)
+                strcpy(msg, "WARNING: DNS lookup failed for ");
+            else
+                strcpy(msg, cached ? "Cached " : "Resolved ");
+            len = strlen(msg);
+            for (i = 0; i < 30 && host[i]; i++)
+                msg[len + i] = host[i];
+            msg[len + i] = '\0';
+            log_msg(level, msg);
+        }
+
+        for (i = 0; i < found && slot_count < MAX_SERVER_ADDRS; i++) {
+            for (j = 0; j < slot_count; j++) {
+                if (query_slots[j].ip_addr == addrs[i])
+                    break;
+            }
+            if (j == slot_count)
+                query_slots[slot_count++].ip_addr = addrs[i];
+        }
+    }
+
+    /* Cache hits take no time and would hide the real lookup cost */
+    if (looked_up) {
+        clock_get_precise_time(&end);
+        stats_record_dns(elapsed_ms(&start, &end));
+    }
+
+    /* Every server is holding us off: wait instead of failing over DNS */
+    if (slot_count == 0 && min_held > 0) {
+        hold_secs = min_held;
+        log_msg(LOG_ERROR, "ERROR: All servers asked us to back off");
+        return sync_finish(STATUS_ERROR, "Rate limited");
+    }
+
+    if (slot_count == 0) {
+        log_msg(LOG_ERROR, "ERROR: DNS lookup failed");
+        return sync_finish(STATUS_ERROR, "DNS failed");
+    }
+
+    if (log_enabled(LOG_DEBUG)) {
+        strcpy(msg, "Querying ");
+        p = append_uint(msg + 9, (ULONG)slot_count, 1);
+        strcpy(p, (slot_count == 1) ? " address" : " addresses");
+        log_msg(LOG_DEBUG, msg);
+    }
+
+    sync_state = SYNC_STATE_SEND;
+    return STATUS_SYNCING;
+}
+
+/*
+ * step_send - Send one request to every resolved address
+ *
+ * All requests go out from a single UDP socket so one WaitSelect()
+ * covers every reply. t1 of each request is nudged apart by 16us
+ * (one fraction step of the encoding) so every origin timestamp is
+ * unique even when read within the same microsecond step. The offset
+ * math uses the time sendto() returned instead.
+ *
+ * Later rounds of a burst keep the socket; a late reply to an earlier
+ * round no longer matches any t1 and is dropped.
+ */
+static LONG step_send(void)
+{
+    UBYTE packet[NTP_PACKET_SIZE];
+    LONG i;
+
+    log_msg(LOG_DEBUG, "Sending NTP requests to port 123...");
+
+    sent_count = 0;
+    answer_count = 0;
+    for (i = 0; i < slot_count; i++) {
+        query_slots[i].pending = FALSE;
+        if (burst_round == 0) {
+            query_slots[i].sample_count = 0;
+            query_slots[i].kiss = KISS_NONE;
+        }
+    }
+
+    if (burst_round == 0 && network_open_udp())
+        network_drain_udp();
+
+    if (network_open_udp()) {
+        clock_get_system_time(&send_time.secs, &send_time.micro);
+
+        for (i = 0; i < slot_count; i++) {
+            QuerySlot *q = &query_slots[i];
+
+            /* No more packets to a server that kissed us */
+            if (q->kiss != KISS_NONE)
+                continue;
+
+            clock_get_precise_time(&q->t1);
+            q->t1.micro += (ULONG)i * 16;
+            if (q->t1.micro >= 1000000UL) {
+                q->t1.micro -= 1000000UL;
+                q->t1.secs++;
+            }
+
+            sntp_build_request(packet, &q->t1);
+            q->pending = network_send_udp(q->ip_addr, NTP_PORT, packet,
+                                          NTP_PACKET_SIZE, &q->sent);
+            if (q->pending)
+                sent_count++;
+        }
+    }
+
+    /* A failed round within a burst just leaves fewer samples */
+    if (sent_count == 0 && burst_round == 0) {
+        log_msg(LOG_ERROR, "ERROR: Failed to send UDP packet");
+        return sync_finish(STATUS_ERROR, "Send failed");
+    }
+
+    sync_state = SYNC_STATE_AWAIT;
+    return STATUS_SYNCING;
+}
+
+/*
+ * Helper: act on a Kiss-of-Death that answers one of our requests
+ *
+ * Only a kiss echoing a pending request's origin is believed, so a
+ * forged packet can't silence a server.
+ */
+static void handle_kiss(UBYTE kiss, const SNTPResponse *resp)
+{
+    ULONG hold;
+    LONG i;
+
+    for (i = 0; i < slot_count; i++) {
+        QuerySlot *q = &query_slots[i];
+
+        if (!q->pending || !sntp_matches_request(resp, &q->t1))
+            continue;
+
+        q->pending = FALSE;
+        q->kiss = kiss;
+        answer_count++;
+
+        hold = network_kiss_address(q->ip_addr, kiss, sntp_poll_secs(resp));
+        if (hold > 0 && (hold_secs == 0 || hold < hold_secs))
+            hold_secs = hold;
+        log_kiss(kiss, q->ip_addr, hold);
+        return;
+    }
+}
+
+/* Read every reply already queued on the socket and match it by origin */
+static void drain_replies(void)
+{
+    UBYTE packet[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    AmigaTime t4;
+    LONG bytes, i;
+    UBYTE kiss;
+
+    while (answer_count < sent_count) {
+        bytes = network_recv_udp(packet, NTP_PACKET_SIZE, 0, NULL, &t4);
+        if (bytes < 0)
+            break;
+        if (bytes < NTP_PACKET_SIZE)
+            continue;
+        if (!sntp_parse_response(packet, &resp)) {
+            kiss = sntp_parse_kiss(packet, &resp);
+            if (kiss != KISS_NONE)
+                handle_kiss(kiss, &resp);
+            continue;
+        }
+
+        for (i = 0; i < slot_count; i++) {
+            QuerySlot *q = &query_slots[i];
+
+            if (!q->pending)
+                continue;
+            if (sntp_compute_sample(&resp, &q->t1, &q->sent, &t4, sync_tz,
+                                    &q->samples[q->sample_count])) {
+                q->pending = FALSE;
+                q->sample_count++;
+                answer_count++;
+                q->poll_secs = sntp_poll_secs(&resp);
+                break;
+            }
+        }
+    }
+}
+
+/* Helper to filter each address's burst and pick the lowest-delay result */
+static LONG filter_slots(void)
+{
+    char msg[64];
+    char *p;
+    LONG i, agree, answered = 0;
+
+    best_slot = NULL;
+    for (i = 0; i < slot_count; i++) {
+        QuerySlot *q = &query_slots[i];
+
+        if (q->sample_count == 0)
+            continue;
+        answered++;
+
+        agree = sntp_filter_samples(q->samples, q->sample_count, &q->sample);
+        if (agree < q->sample_count && log_enabled(LOG_DEBUG)) {
+            strcpy(msg, "Filter: ");
+            format_ip(q->ip_addr, msg + 8);
+            p = msg + strlen(msg);
+            strcpy(p, " rejected ");
+            p = append_uint(p + 10, (ULONG)(q->sample_count - agree), 1);
+            *p++ = '/';
+            append_uint(p, q->sample_count, 1);
+            log_msg(LOG_DEBUG, msg);
+        }
+
+        if (best_slot == NULL ||
+            q->sample.delay_micro < best_slot->sample.delay_micro)
+            best_slot = q;
+    }
+    return answered;
+}
+
+/*
+ * step_await - Collect replies until all are in or the deadline passes
+ *
+ * Between burst rounds it waits out BURST_SPACING_MS even once every
+ * reply is in, then sends the next round.
+ */
+static LONG step_await(BOOL readable)
+{
+    AmigaTime now;
+    char msg[64];
+    char *p;
+    LONG i, answered;
+    ULONG waited;
+
+    if (readable)
+        drain_replies();
+
+    clock_get_system_time(&now.secs, &now.micro);
+    waited = elapsed_ms(&send_time, &now);
+
+    /* A socket dropped after an error ends the burst with what is in */
+    if (burst_round + 1 < burst_rounds && network_udp_is_open()) {
+        if (waited < BURST_SPACING_MS)
+            return STATUS_SYNCING;
+        burst_round++;
+        sync_state = SYNC_STATE_SEND;
+        return STATUS_SYNCING;
+    }
+
+    /* Keep waiting unless everything arrived, the deadline passed or
+     * network_wait() dropped the socket after an error */
+    if (answer_count < sent_count && network_udp_is_open() &&
+        waited < QUERY_TIMEOUT_MS)
+        return STATUS_SYNCING;
+
+    /* Let the DNS cache rotate away from addresses that didn't answer;
+     * kissed ones are already held back and keep their strikes */
+    for (i = 0; i < slot_count; i++) {
+        if (query_slots[i].kiss == KISS_NONE)
+            network_mark_address(query_slots[i].ip_addr,
+                                 query_slots[i].sample_count > 0);
+    }
+
+    answered = filter_slots();
+    if (answered == 0 && hold_secs > 0) {
+        log_msg(LOG_ERROR, "ERROR: Servers asked us to back off");
+        return sync_finish(STATUS_ERROR, "Rate limited");
+    }
+    if (answered == 0) {
+        log_msg(LOG_ERROR, "ERROR: Timeout waiting for response");
+        return sync_finish(STATUS_ERROR, "Timeout");
+    }
+
+    /* Otherwise only the server we use gets a say in the next poll,
+     * and never beyond MAXINTERVAL */
+    hold_secs = best_slot->poll_secs;
+    if (hold_secs > (ULONG)config_get()->max_interval)
+        hold_secs = (ULONG)config_get()->max_interval;
+
+    if (log_enabled(LOG_DEBUG)) {
+        strcpy(msg, "Valid replies: ");
+        p = append_uint(msg + 15, (ULONG)answered, 1);
+        *p++ = '/';
+        append_uint(p, (ULONG)slot_count, 1);
+        log_msg(LOG_DEBUG, msg);
+    }
+
+    sync_state = SYNC_STATE_APPLY;
+    return STATUS_SYNCING;
+}
+
+/*
+ * apply_sample - Correct the system clock by one sample
+ *
+ * Shared by the query state machine and broadcast listening;
+ * ip_addr is the server the sample came from. Finishes the sync.
+ */
+static LONG apply_sample(ULONG ip_addr, const SNTPSample *sample,
+                         const char *done_text)
+{
+    SyncConfig *cfg;
+    char msg[64];
+    char *p;
+    LONG micro;
+
+    if (log_enabled(LOG_DEBUG)) {
+        strcpy(msg, "Using ");
+        format_ip(ip_addr, msg + 6);
+        log_msg(LOG_DEBUG, msg);
+    }
+
+    if (log_enabled(LOG_INFO)) {
+        strcpy(msg, "Offset ");
+        format_offset(&sample->offset, msg + 7);
+        log_msg(LOG_INFO, msg);
+    }
+
+    if (log_enabled(LOG_DEBUG)) {
+        strcpy(msg, "Round-trip delay ");
+        p = append_uint(msg + 17, (ULONG)sample->delay_micro / 1000, 1);
+        strcpy(p, " ms");
+        log_msg(LOG_DEBUG, msg);
+    }
+
+    result_addr  = ip_addr;
+    result_delay = sample->delay_micro;
+    result_stratum = sample->stratum;
+
+    /* Small offsets can be slewed so the clock never jumps; anything
+     * beyond the limit, or a clock without a slew timer, is stepped */
+    cfg = config_get();
+    micro = sntp_offset_to_micro(&sample->offset);
+    stats_record_sample(micro, sample->delay_micro);
+    if (cfg->slew && micro <= cfg->slew_limit * 1000L &&
+        micro >= -cfg->slew_limit * 1000L &&
+        clock_slew_start(micro)) {
+        log_msg(LOG_DEBUG, "Slewing system clock...");
+        clock_get_system_time(&result_time.secs, &result_time.micro);
+    } else {
+        log_msg(LOG_DEBUG, "Setting system clock...");
+        if (!clock_adjust_system_time(&sample->offset, &result_time)) {
+            log_msg(LOG_ERROR, "ERROR: Failed to set system time");
+            return sync_finish(STATUS_ERROR, "Clock set failed");
+        }
+    }
+
+    drift_update(&sample->offset, &result_time);
+    drift_persist();
+    log_drift();
+
+    log_msg(LOG_INFO, "Clock synchronized successfully!");
+    return sync_finish(STATUS_OK, done_text);
+}
+
+/*
+ * step_apply - Apply the lowest-delay reply to the system clock
+ */
+static LONG step_apply(void)
+{
+    return apply_sample(best_slot->ip_addr, &best_slot->sample, "Synchronized");
+}
+
+/* =========================================================================
+ * Public API
+ * ========================================================================= */
+
+/*
+ * sync_start - Begin a new sync
+ *
+ * Looks up the configured timezone and queues the resolve step.
+ * Returns FALSE if a sync is already in progress.
+ */
+BOOL sync_start(void)
+{
+    if (sync_state != SYNC_STATE_IDLE)
+        return FALSE;
+
+    sync_tz = tz_find_by_name(config_get()->tz_name);
+    if (sync_tz == NULL) {
+        log_msg(LOG_WARN, "WARNING: Unknown timezone, using UTC");
+        /* Fall through with NULL tz - tz_get_offset_mins handles NULL */
+    }
+
+    burst_rounds = config_get()->burst;
+    burst_round = 0;
+    hold_secs = 0;
+
+    sync_state = SYNC_STATE_RESOLVE;
+    return TRUE;
+}
+
+/*
+ * sync_start_address - Begin a sync with one given server address
+ *
+ * Like sync_start(), but skips the lookup and queries only ip_addr,
+ * e.g. the broadcast server to calibrate its delay. Returns FALSE if
+ * a sync is already in progress or the address is held back by a
+ * Kiss-of-Death.
+ */
+BOOL sync_start_address(ULONG ip_addr)
+{
+    if (network_address_held(ip_addr) || !sync_start())
+        return FALSE;
+
+    slot_count = 1;
+    query_slots[0].ip_addr = ip_addr;
+    sync_state = SYNC_STATE_SEND;
+    return TRUE;
+}
+
+/*
+ * sync_apply_sample - Apply a sample obtained outside a query
+ *
+ * Used for broadcasts: runs the same slew/step, drift and statistics
+ * path as a finished query. Returns STATUS_OK or STATUS_ERROR like
+ * sync_step(), or STATUS_IDLE if a query is in progress.
+ */
+LONG sync_apply_sample(ULONG ip_addr, const SNTPSample *sample)
+{
+    if (sync_state != SYNC_STATE_IDLE)
+        return STATUS_IDLE;
+
+    hold_secs = 0;
+    return apply_sample(ip_addr, sample, "Synchronized (broadcast)");
+}
+
+/* sync_abort: drop any sync in progress; late replies are drained later */
+void sync_abort(void)
+{
+    if (sync_state != SYNC_STATE_IDLE)
+        sync_finish(STATUS_IDLE, "Idle");
+}
+
+/* sync_busy: TRUE while a sync is in progress */
+BOOL sync_busy(void)
+{
+    return (sync_state != SYNC_STATE_IDLE);
+}
+
+/* sync_awaiting: TRUE while replies are expected on the socket */
+BOOL sync_awaiting(void)
+{
+    return (sync_state == SYNC_STATE_AWAIT);
+}
+
+/*
+ * sync_wait_timeout - How long event_loop() may sleep before the next step
+ *
+ * 0 when a step can run right away, the time left until the reply
+ * deadline (or the next burst round) while awaiting replies,
+ * WAIT_FOREVER when idle.
+ */
+ULONG sync_wait_timeout(void)
+{
+    AmigaTime now;
+    ULONG waited, limit;
+
+    if (sync_state == SYNC_STATE_IDLE)
+        return WAIT_FOREVER;
+    if (sync_state != SYNC_STATE_AWAIT)
+        return 0;
+
+    clock_get_system_time(&now.secs, &now.micro);
+    waited = elapsed_ms(&send_time, &now);
+    limit = (burst_round + 1 < burst_rounds) ? BURST_SPACING_MS : QUERY_TIMEOUT_MS;
+    return (waited >= limit) ? 0 : limit - waited;
+}
+
+/*
+ * sync_step - Run the next step of the sync in progress
+ *
+ * readable is TRUE if network_wait() reported data on the socket.
+ * Returns STATUS_SYNCING while the sync continues, then STATUS_OK or
+ * STATUS_ERROR once it has finished (see sync_result_text()).
+ */
+LONG sync_step(BOOL readable)
+{
+    switch (sync_state) {
+        case SYNC_STATE_RESOLVE:
+            return step_resolve();
+        case SYNC_STATE_SEND:
+            return step_send();
+        case SYNC_STATE_AWAIT:
+            return step_await(readable);
+        case SYNC_STATE_APPLY:
+            return step_apply();
+    }
+    return STATUS_IDLE;
+}
+
+/* sync_result_text: short description of how the last sync ended */
+const char *sync_result_text(void)
+{
+    return result_text;
+}
+
+/*
+ * sync_hold_secs - Shortest wait before the next sync the servers asked for
+ *
+ * After a sync refused by Kiss-of-Death (or skipped because every
+ * address is held back) the shortest hold; after a good sync the poll
+ * interval the chosen server asked for. 0 if there is no such limit.
+ */
+ULONG sync_hold_secs(void)
+{
+    return hold_secs;
+}
+
+/* sync_result_addr: server used by the last successful sync */
+ULONG sync_result_addr(void)
+{
+    return result_addr;
+}
+
+/* sync_result_delay: round-trip delay to it, microseconds */
+LONG sync_result_delay(void)
+{
+    return result_delay;
+}
+
+/* sync_result_stratum: its stratum */
+UBYTE sync_result_stratum(void)
+{
+    return result_stratum;
+}
+
+/* sync_result_time: clock value set by the last successful sync */
+const AmigaTime *sync_result_time(void)
+{
+    return &result_time;
+}
@@ -1,7 +1,9 @@
 /* tz.c - Timezone database functions for SyncTime
  *
  * Provides timezone lookup, region/city enumeration, and DST calculation.
- * Works with the generated tz_table[] from tz_table.c.
+ * Works with the generated tz_table[] from tz_table.c, whose entries
+ * refer into a shared string pool and a table of distinct DST rules,
+ * or with the same tables read from an optional SyncTime.tz data file.
  *
  * Amiga epoch is Jan 1, 1978 00:00:00 UTC.
  */
@@ -16,98 +18,67 @@
 #define SECS_PER_HOUR  3600
 #define SECS_PER_DAY   86400
 
-/* Maximum regions (12 should cover all IANA regions) */
-#define MAX_REGIONS    17  /* 16 + 1 for NULL terminator */
-
-/* Maximum cities per region */
-#define MAX_CITIES     200
-
-/* Amiga epoch year */
-#define AMIGA_EPOCH_YEAR 1978
-
 /* =========================================================================
  * Static module state
  * ========================================================================= */
 
-/* Cached region list - built on first call to tz_get_regions */
-static const char *region_list[MAX_REGIONS];
-static ULONG region_count = 0;
-static BOOL regions_initialized = FALSE;
-
-/* Cached city list for current region query */
-static const TZEntry *city_list[MAX_CITIES];
-static ULONG city_count = 0;
-static const char *cached_region = NULL;
-
-/* =========================================================================
- * Days in each month (non-leap year)
- * ========================================================================= */
-
-static const UBYTE days_in_month[12] = {
-    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
-};
-
-/* =========================================================================
- * Helper: check if year is a leap year
- * ========================================================================= */
-
-static BOOL is_leap_year(LONG year)
-{
-    if ((year % 4) != 0)
-        return FALSE;
-    if ((year % 100) != 0)
-        return TRUE;
-    if ((year % 400) != 0)
-        return FALSE;
-    return TRUE;
-}
-
-/* =========================================================================
- * Helper: get days in a month (accounting for leap years)
- * ========================================================================= */
-
-static UBYTE get_days_in_month(LONG year, UBYTE month)
-{
-    if (month < 1 || month > 12)
-        return 0;
-    if (month == 2 && is_leap_year(year))
-        return 29;
-    return days_in_month[month - 1];
-}
-
-/* =========================================================================
- * Helper: calculate day of week using Zeller's congruence
- *
- * Returns 0=Sunday, 1=Monday, ... 6=Saturday
- * ========================================================================= */
-
-static UBYTE day_of_week(LONG year, UBYTE month, UBYTE day)
-{
-    LONG y, m, q, k, j, h;
-
-    /* Zeller's congruence treats Jan and Feb as months 13 and 14 of prev year */
-    if (month < 3) {
-        m = month + 12;
-        y = year - 1;
-    } else {
-        m = month;
-        y = year;
-    }
-
-    q = day;
-    k = y % 100;
-    j = y / 100;
-
-    /* Zeller's formula for Gregorian calendar */
-    h = (q + (13 * (m + 1)) / 5 + k + k / 4 + j / 4 - 2 * j) % 7;
-
-    /* Convert from Zeller's 0=Sat to 0=Sun */
-    /* Zeller: 0=Sat, 1=Sun, 2=Mon, ... 6=Fri */
-    /* We want: 0=Sun, 1=Mon, ... 6=Sat */
-    h = ((h + 6) % 7);
-
-    return (UBYTE)h;
-}
+/* DST transitions of the last zone and year looked up, as UTC seconds.
+ * Valid while dst_cache_zone is set and the time falls in the year. */
+static const TZEntry *dst_cache_zone = NULL;
+static ULONG dst_cache_year_start;  /* First second of the cached year */
+static ULONG dst_cache_year_end;    /* First second of the next year */
+static ULONG dst_cache_start;       /* DST begins */
+static ULONG dst_cache_end;         /* DST ends */
+
+/* One loaded set of timezone tables */
+typedef struct {
+    const char        *strings;
+    const TZRule      *rules;
+    const TZEntry     *zones;
+    ULONG              zone_count;
+    const TZRegion    *regions;
+    const char *const *region_names;
+    ULONG              region_count;
+} TZData;
+
+/* Data file header, decoded */
+typedef struct {
+    UWORD pool_size;
+    UWORD rule_count;
+    UWORD zone_count;
+    UWORD region_count;
+    ULONG rules_at;      /* File offsets of each section */
+    ULONG zones_at;
+    ULONG strings_at;
+} TZFileHeader;
+
+#define TZ_FILE_MAGIC        "STTZ"
+#define TZ_FILE_VERSION      2
+#define TZ_FILE_HEADER_SIZE  16
+#define TZ_FILE_RULE_SIZE    14
+#define TZ_FILE_PROGDIR      "PROGDIR:SyncTime.tz"
+#define TZ_FILE_ENVARC       "ENVARC:SyncTime.tz"
+#define TZ_NAME_MAX          48   /* Matches SyncConfig.tz_name */
+
+/* Built-in table from tz_table.c (empty when built with NO_TZ_BUILTIN) */
+static TZData builtin_data;
+#ifdef NO_TZ_BUILTIN
+static const char *const no_region_names[1] = { NULL };
+#endif
+
+/* Whole data file, once the region/city lists have been asked for */
+static TZData file_data;
+static APTR   file_block = NULL;
+static char   tz_file_path[32];   /* Empty when there is no data file */
+
+/* The one zone read from the data file before a full load */
+static TZData  zone_data;
+static TZEntry zone_entry;
+static TZRule  zone_rule;
+static TZRegion zone_region;
+static const char *zone_region_names[2];
+static char    zone_strings[2 * TZ_NAME_MAX];  /* "Region\0Region/City\0" */
+static BOOL    zone_loaded = FALSE;
 
 /* =========================================================================
  * Helper: find day of month for "Nth DOW of month"
@@ -127,10 +98,10 @@ static UBYTE nth_dow_of_month(LONG year, UBYTE month, UBYTE week, UBYTE dow)
     if (month < 1 || month > 12 || week < 1 || week > 5 || dow > 6)
         return 1;  /* Invalid input, return safe default */
 
-    days_this_month = get_days_in_month(year, month);
+    days_this_month = cal_days_in_month(year, month);
 
     /* Find what day of week the 1st of the month is */
-    first_dow = day_of_week(year, month, 1);
+    first_dow = cal_day_of_week(cal_days_from_civil(year, month, 1));
 
     /* Find the first occurrence of the target day of week */
     if (dow >= first_dow)
@@ -155,209 +126,551 @@ static UBYTE nth_dow_of_month(LONG year, UBYTE month, UBYTE week, UBYTE dow)
 }
 
 /* =========================================================================
- * Helper: convert Amiga seconds to year/month/day/hour components
+ * Helper: convert a date and hour to seconds since Amiga epoch
  *
- * Amiga epoch: Jan 1, 1978 00:00:00
+ * Used to calculate DST transition times
  * ========================================================================= */
 
-static void amiga_secs_to_date(ULONG secs, LONG *year, UBYTE *month,
-                               UBYTE *day, UBYTE *hour)
+static ULONG date_to_amiga_secs(LONG year, UBYTE month, UBYTE day, UBYTE hour)
 {
-    ULONG days_remaining;
-    ULONG days_in_year;
-    LONG y;
-    UBYTE m;
-    UBYTE dim;
-
-    /* Extract time of day */
-    days_remaining = secs / SECS_PER_DAY;
-    if (hour)
-        *hour = (UBYTE)((secs % SECS_PER_DAY) / SECS_PER_HOUR);
-
-    /* Count years from 1978 */
-    y = AMIGA_EPOCH_YEAR;
-    for (;;) {
-        days_in_year = is_leap_year(y) ? 366 : 365;
-        if (days_remaining < days_in_year)
-            break;
-        days_remaining -= days_in_year;
-        y++;
+    return cal_days_from_civil(year, month, day) * SECS_PER_DAY +
+           (ULONG)hour * SECS_PER_HOUR;
+}
+
+/* =========================================================================
+ * Data file loading
+ *
+ * SyncTime.tz, written by gen_tz_table.py --binary, holds the same
+ * tables as tz_table.c in big-endian byte order:
+ *
+ *   header   "STTZ", version, pool size, rule/zone/region counts
+ *   regions  region_count x { UWORD first, count, name }
+ *   rules    rule_count   x 14 bytes (TZRule)
+ *   zones    zone_count   x 8 bytes  (TZEntry)
+ *   strings  pool_size bytes
+ *
+ * Only the configured zone is read at startup, by a binary search of
+ * the zone records on disk. Everything else is loaded the first time
+ * the region/city lists are asked for, i.e. when the picker opens.
+ * ========================================================================= */
+
+/* Read a big-endian 16-bit value */
+static UWORD get_be16(const UBYTE *p)
+{
+    return (UWORD)(((UWORD)p[0] << 8) | p[1]);
+}
+
+/* Open the data file and read its header. Returns 0 on failure. */
+static BPTR tz_file_open(TZFileHeader *hdr)
+{
+    UBYTE raw[TZ_FILE_HEADER_SIZE];
+    BPTR fh;
+
+    if (tz_file_path[0] == '\0')
+        return 0;
+
+    fh = Open((STRPTR)tz_file_path, MODE_OLDFILE);
+    if (!fh)
+        return 0;
+
+    if (Read(fh, raw, TZ_FILE_HEADER_SIZE) != TZ_FILE_HEADER_SIZE ||
+        memcmp(raw, TZ_FILE_MAGIC, 4) != 0 ||
+        get_be16(raw + 4) != TZ_FILE_VERSION) {
+        Close(fh);
+        return 0;
     }
 
-    if (year)
-        *year = y;
+    hdr->pool_size    = get_be16(raw + 6);
+    hdr->rule_count   = get_be16(raw + 8);
+    hdr->zone_count   = get_be16(raw + 10);
+    hdr->region_count = get_be16(raw + 12);
+
+    hdr->rules_at   = TZ_FILE_HEADER_SIZE + (ULONG)hdr->region_count * 6;
+    hdr->zones_at   = hdr->rules_at +
+                      (ULONG)hdr->rule_count * TZ_FILE_RULE_SIZE;
+    hdr->strings_at = hdr->zones_at + (ULONG)hdr->zone_count * 8;
+
+    return fh;
+}
+
+/* Read len bytes at pos. Returns TRUE if all were read. */
+static BOOL tz_file_read(BPTR fh, ULONG pos, APTR buf, LONG len)
+{
+    if (Seek(fh, (LONG)pos, OFFSET_BEGINNING) < 0)
+        return FALSE;
+    return Read(fh, buf, len) == len;
+}
+
+/* Read a NUL-terminated string from the pool into buf */
+static BOOL tz_file_string(BPTR fh, const TZFileHeader *hdr, UWORD offset,
+                           char *buf, LONG size)
+{
+    LONG got;
+
+    if (offset >= hdr->pool_size ||
+        Seek(fh, (LONG)(hdr->strings_at + offset), OFFSET_BEGINNING) < 0)
+        return FALSE;
+
+    if (size > (LONG)(hdr->pool_size - offset))
+        size = (LONG)(hdr->pool_size - offset);
+    got = Read(fh, buf, size);
+    if (got <= 0)
+        return FALSE;
+
+    /* The terminator must be within what was read */
+    for (size = 0; size < got && buf[size] != '\0'; size++)
+        ;
+    return size < got;
+}
+
+/* Decode records read raw from the file, in place */
+static void decode_rule(TZRule *r)
+{
+    UBYTE raw[TZ_FILE_RULE_SIZE];
+
+    memcpy(raw, r, sizeof(raw));
+    r->dst_offset_mins = (WORD)get_be16(raw);
+    r->dst_start_month = raw[2];
+    r->dst_start_week  = raw[3];
+    r->dst_start_dow   = raw[4];
+    r->dst_start_hour  = raw[5];
+    r->dst_end_month   = raw[6];
+    r->dst_end_week    = raw[7];
+    r->dst_end_dow     = raw[8];
+    r->dst_end_hour    = raw[9];
+    r->dst_start_at    = raw[10];
+    r->dst_end_at      = raw[11];
+    r->dst_start_min   = raw[12];
+    r->dst_end_min     = raw[13];
+}
+
+static void decode_zone(TZEntry *e)
+{
+    UBYTE raw[8];
+
+    memcpy(raw, e, sizeof(raw));
+    e->name            = get_be16(raw);
+    e->city            = raw[2];
+    e->region          = raw[3];
+    e->std_offset_mins = (WORD)get_be16(raw + 4);
+    e->rule            = raw[6];
+    e->pad             = 0;
+}
 
-    /* Count months */
-    m = 1;
-    for (;;) {
-        dim = get_days_in_month(y, m);
-        if (days_remaining < dim)
+/*
+ * Helper: read just the named zone from the file into zone_data
+ *
+ * Binary search over the on-disk zone records, one seek and two small
+ * reads per step.
+ */
+static BOOL tz_file_load_zone(const char *name)
+{
+    TZFileHeader hdr;
+    char buf[TZ_NAME_MAX];
+    UBYTE raw[6];
+    TZEntry e;
+    TZRule rule;
+    BPTR fh;
+    ULONG lo, hi, mid;
+    LONG rlen;
+    int cmp;
+    BOOL found = FALSE;
+
+    fh = tz_file_open(&hdr);
+    if (!fh)
+        return FALSE;
+
+    lo = 0;
+    hi = hdr.zone_count;
+    while (lo < hi && !found) {
+        mid = lo + (hi - lo) / 2;
+        if (!tz_file_read(fh, hdr.zones_at + mid * 8, &e, 8))
             break;
-        days_remaining -= dim;
-        m++;
-        if (m > 12) {
-            m = 12;  /* Safety check */
+        decode_zone(&e);
+        if (!tz_file_string(fh, &hdr, e.name, buf, sizeof(buf)))
             break;
+        cmp = strcmp(name, buf);
+        if (cmp == 0)
+            found = TRUE;
+        else if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    /* Pool for the single zone: "Region\0Region/City\0" */
+    if (found &&
+        e.rule < hdr.rule_count && e.region < hdr.region_count &&
+        tz_file_read(fh, hdr.rules_at + (ULONG)e.rule * TZ_FILE_RULE_SIZE,
+                     &rule, TZ_FILE_RULE_SIZE) &&
+        tz_file_read(fh, TZ_FILE_HEADER_SIZE + (ULONG)e.region * 6, raw, 6) &&
+        tz_file_string(fh, &hdr, get_be16(raw + 4), buf, sizeof(buf))) {
+        decode_rule(&rule);
+        zone_rule = rule;
+
+        rlen = strlen(buf) + 1;
+        strcpy(zone_strings, buf);
+        strcpy(zone_strings + rlen, name);
+
+        if (dst_cache_zone == &zone_entry)
+            dst_cache_zone = NULL;
+
+        zone_entry.name   = (UWORD)rlen;
+        zone_entry.city   = e.city;
+        zone_entry.region = 0;
+        zone_entry.std_offset_mins = e.std_offset_mins;
+        zone_entry.rule   = 0;
+        zone_entry.pad    = 0;
+        zone_loaded = TRUE;
+    } else {
+        found = FALSE;
+    }
+
+    Close(fh);
+    return found;
+}
+
+/*
+ * Helper: load the whole data file into file_data
+ *
+ * One allocation holds the decoded tables, region name pointers and
+ * string pool. Kept until tz_cleanup(), since entries handed out
+ * earlier point into it.
+ */
+static BOOL tz_file_load_all(void)
+{
+    TZFileHeader hdr;
+    UBYTE raw[6];
+    UBYTE *block;
+    TZRegion *regions;
+    TZRule *rules;
+    TZEntry *zones;
+    const char **names;
+    char *strings;
+    ULONG size, i;
+    BPTR fh;
+    BOOL ok;
+
+    fh = tz_file_open(&hdr);
+    if (!fh)
+        return FALSE;
+
+    size = (ULONG)hdr.region_count * sizeof(TZRegion) +
+           ((ULONG)hdr.region_count + 1) * sizeof(const char *) +
+           (ULONG)hdr.rule_count * sizeof(TZRule) +
+           (ULONG)hdr.zone_count * sizeof(TZEntry) +
+           hdr.pool_size + 1;
+
+    block = (UBYTE *)AllocVec(size, MEMF_ANY | MEMF_CLEAR);
+    if (!block) {
+        Close(fh);
+        return FALSE;
+    }
+
+    names   = (const char **)block;
+    regions = (TZRegion *)(names + hdr.region_count + 1);
+    rules   = (TZRule *)(regions + hdr.region_count);
+    zones   = (TZEntry *)(rules + hdr.rule_count);
+    strings = (char *)(zones + hdr.zone_count);
+
+    ok = tz_file_read(fh, hdr.strings_at, strings, hdr.pool_size);
+
+    for (i = 0; ok && i < hdr.region_count; i++) {
+        ok = tz_file_read(fh, TZ_FILE_HEADER_SIZE + i * 6, raw, 6) &&
+             get_be16(raw + 4) < hdr.pool_size;
+        if (ok) {
+            regions[i].first = get_be16(raw);
+            regions[i].count = get_be16(raw + 2);
+            names[i] = strings + get_be16(raw + 4);
         }
     }
 
-    if (month)
-        *month = m;
-    if (day)
-        *day = (UBYTE)(days_remaining + 1);  /* Days are 1-based */
+    if (ok && hdr.rule_count > 0)
+        ok = tz_file_read(fh, hdr.rules_at, rules,
+                          (LONG)hdr.rule_count * TZ_FILE_RULE_SIZE);
+    for (i = 0; ok && i < hdr.rule_count; i++)
+        decode_rule(&rules[i]);
+
+    if (ok && hdr.zone_count > 0)
+        ok = tz_file_read(fh, hdr.zones_at, zones, (LONG)hdr.zone_count * 8);
+    for (i = 0; ok && i < hdr.zone_count; i++) {
+        decode_zone(&zones[i]);
+        ok = zones[i].name < hdr.pool_size &&
+             zones[i].rule < hdr.rule_count &&
+             zones[i].region < hdr.region_count;
+    }
+
+    Close(fh);
+
+    if (!ok) {
+        FreeVec(block);
+        return FALSE;
+    }
+
+    file_block             = block;
+    file_data.strings      = strings;
+    file_data.rules        = rules;
+    file_data.zones        = zones;
+    file_data.zone_count   = hdr.zone_count;
+    file_data.regions      = regions;
+    file_data.region_names = names;
+    file_data.region_count = hdr.region_count;
+    return TRUE;
+}
+
+/* Helper: the table set an entry belongs to */
+static const TZData *data_for(const TZEntry *tz)
+{
+    if (tz == &zone_entry)
+        return &zone_data;
+    if (file_block && tz >= file_data.zones &&
+        tz < file_data.zones + file_data.zone_count)
+        return &file_data;
+    return &builtin_data;
+}
+
+/* Helper: the table set used for region/city lists, loading it if needed */
+static const TZData *list_data(void)
+{
+    if (!file_block && tz_file_path[0] != '\0' && !tz_file_load_all())
+        tz_file_path[0] = '\0';  /* Unreadable: use the built-in table */
+
+    return file_block ? &file_data : &builtin_data;
 }
 
 /* =========================================================================
- * Helper: convert year/month/day/hour to seconds since Amiga epoch
+ * tz_init - Locate the timezone data file
  *
- * Used to calculate DST transition times
+ * Looks for SyncTime.tz next to the program, then in ENVARC:. Nothing
+ * is read yet. Without a file the built-in table (if compiled in) is
+ * used.
  * ========================================================================= */
 
-static ULONG date_to_amiga_secs(LONG year, UBYTE month, UBYTE day, UBYTE hour)
+void tz_init(void)
 {
-    ULONG secs = 0;
-    LONG y;
-    UBYTE m;
+    static const char *const paths[] = { TZ_FILE_PROGDIR, TZ_FILE_ENVARC };
+    TZFileHeader hdr;
+    BPTR fh;
+    ULONG i;
 
-    /* Count days from years */
-    for (y = AMIGA_EPOCH_YEAR; y < year; y++) {
-        secs += (is_leap_year(y) ? 366 : 365) * SECS_PER_DAY;
+#ifndef NO_TZ_BUILTIN
+    builtin_data.strings      = tz_strings;
+    builtin_data.rules        = tz_rules;
+    builtin_data.zones        = tz_table;
+    builtin_data.zone_count   = tz_table_count;
+    builtin_data.regions      = tz_regions;
+    builtin_data.region_names = tz_region_names;
+    builtin_data.region_count = tz_region_count;
+#else
+    builtin_data.region_names = no_region_names;
+#endif
+
+    zone_data.strings      = zone_strings;
+    zone_data.rules        = &zone_rule;
+    zone_data.zones        = &zone_entry;
+    zone_data.zone_count   = 1;
+    zone_data.regions      = &zone_region;
+    zone_data.region_names = zone_region_names;
+    zone_data.region_count = 1;
+    zone_region.first      = 0;
+    zone_region.count      = 1;
+    zone_region_names[0]   = zone_strings;
+    zone_region_names[1]   = NULL;
+
+    tz_file_path[0] = '\0';
+    for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        strcpy(tz_file_path, paths[i]);
+        fh = tz_file_open(&hdr);
+        if (fh) {
+            Close(fh);
+            return;
+        }
     }
+    tz_file_path[0] = '\0';
+}
 
-    /* Count days from months */
-    for (m = 1; m < month; m++) {
-        secs += get_days_in_month(year, m) * SECS_PER_DAY;
+/* =========================================================================
+ * tz_cleanup - Free the loaded data file
+ * ========================================================================= */
+
+void tz_cleanup(void)
+{
+    if (file_block) {
+        FreeVec(file_block);
+        file_block = NULL;
     }
+    dst_cache_zone = NULL;
+}
+
+/* =========================================================================
+ * tz_name / tz_region / tz_city / tz_rule - Entry field accessors
+ *
+ * Entries store 8-bit and 16-bit references into the string pool and
+ * rule table of the set they came from (built-in, data file, or the
+ * single zone read at startup); these turn them back into strings and
+ * rules. The city is a suffix of the full name, so it needs no storage.
+ * ========================================================================= */
 
-    /* Add days (1-based, so subtract 1) */
-    secs += (day - 1) * SECS_PER_DAY;
+const char *tz_name(const TZEntry *tz)
+{
+    return data_for(tz)->strings + tz->name;
+}
 
-    /* Add hours */
-    secs += hour * SECS_PER_HOUR;
+const char *tz_region(const TZEntry *tz)
+{
+    return data_for(tz)->region_names[tz->region];
+}
 
-    return secs;
+const char *tz_city(const TZEntry *tz)
+{
+    return data_for(tz)->strings + tz->name + tz->city;
 }
 
-/* =========================================================================
- * Helper: compare two strings for equality
- * ========================================================================= */
+const TZRule *tz_rule(const TZEntry *tz)
+{
+    return &data_for(tz)->rules[tz->rule];
+}
 
-static BOOL str_equal(const char *a, const char *b)
+/* Helper: binary search a table set by name */
+static const TZEntry *find_in(const TZData *d, const char *name)
 {
-    if (!a || !b)
-        return FALSE;
-    while (*a && *b) {
-        if (*a != *b)
-            return FALSE;
-        a++;
-        b++;
+    ULONG lo, hi, mid;
+    int cmp;
+
+    lo = 0;
+    hi = d->zone_count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcmp(name, d->strings + d->zones[mid].name);
+        if (cmp == 0)
+            return &d->zones[mid];
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
-    return (*a == *b);
+
+    return NULL;
 }
 
 /* =========================================================================
  * tz_find_by_name - Find timezone entry by full IANA name
  *
- * Linear search through tz_table[].
+ * Binary search through the zone table, which gen_tz_table.py emits
+ * sorted by name in strcmp() order. Before the data file has been
+ * loaded in full, only the requested zone is read from it.
  * Returns pointer to entry or NULL if not found.
  * ========================================================================= */
 
 const TZEntry *tz_find_by_name(const char *name)
 {
-    ULONG i;
-
     if (!name)
         return NULL;
 
-    for (i = 0; i < tz_table_count; i++) {
-        if (str_equal(tz_table[i].name, name))
-            return &tz_table[i];
+    if (file_block)
+        return find_in(&file_data, name);
+
+    if (tz_file_path[0] != '\0') {
+        if (zone_loaded && strcmp(name, tz_name(&zone_entry)) == 0)
+            return &zone_entry;
+        if (strlen(name) < TZ_NAME_MAX && tz_file_load_zone(name))
+            return &zone_entry;
     }
 
-    return NULL;
+    return find_in(&builtin_data, name);
 }
 
 /* =========================================================================
  * tz_get_regions - Get list of unique region names
  *
- * Builds static array of unique regions on first call.
- * Returns array of region strings, sets count via output parameter.
+ * Returns the NULL-terminated region name array (usable directly as
+ * chooser labels), sets count via output parameter.
  * ========================================================================= */
 
-const char **tz_get_regions(ULONG *count)
+const char *const *tz_get_regions(ULONG *count)
 {
-    ULONG i, j;
-    BOOL found;
-
-    if (!regions_initialized) {
-        region_count = 0;
-
-        for (i = 0; i < tz_table_count && region_count < MAX_REGIONS; i++) {
-            /* Check if this region is already in our list */
-            found = FALSE;
-            for (j = 0; j < region_count; j++) {
-                if (str_equal(region_list[j], tz_table[i].region)) {
-                    found = TRUE;
-                    break;
-                }
-            }
-
-            if (!found) {
-                region_list[region_count++] = tz_table[i].region;
-            }
-        }
-
-        /* NULL-terminate for GadTools GTCY_Labels */
-        if (region_count < MAX_REGIONS)
-            region_list[region_count] = NULL;
-
-        regions_initialized = TRUE;
-    }
+    const TZData *d = list_data();
 
     if (count)
-        *count = region_count;
+        *count = d->region_count;
 
-    return region_list;
+    return d->region_names;
 }
 
 /* =========================================================================
  * tz_get_cities_for_region - Get timezone entries for a region
  *
- * Builds static array of TZEntry pointers for given region.
- * Returns array, sets count via output parameter.
+ * Looks the region up in the region index (binary search; regions
+ * are emitted in strcmp() order). Returns the region's first zone
+ * entry; the region's entries follow it contiguously. Sets count
+ * via output parameter, 0 if the region is unknown.
  * ========================================================================= */
 
-const TZEntry **tz_get_cities_for_region(const char *region, ULONG *count)
+const TZEntry *tz_get_cities_for_region(const char *region, ULONG *count)
 {
-    ULONG i;
+    const TZData *d = list_data();
+    ULONG lo, hi, mid;
+    int cmp;
 
-    /* Check if we already have this region cached */
-    if (cached_region && str_equal(cached_region, region)) {
-        if (count)
-            *count = city_count;
-        return city_list;
+    if (count)
+        *count = 0;
+    if (!region)
+        return d->zones;
+
+    lo = 0;
+    hi = d->region_count;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = strcmp(region, d->region_names[mid]);
+        if (cmp == 0) {
+            if (count)
+                *count = d->regions[mid].count;
+            return &d->zones[d->regions[mid].first];
+        }
+        if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    /* Build new city list for this region */
-    city_count = 0;
-    cached_region = region;
+    return d->zones;
+}
 
-    if (!region) {
-        if (count)
-            *count = 0;
-        return city_list;
-    }
+/* =========================================================================
+ * Helper: check a UTC time against the cached transitions
+ *
+ * Northern hemisphere: DST start month < DST end month
+ * (e.g., March to November in USA)
+ * DST is active when: start <= now < end
+ *
+ * Southern hemisphere: DST start month > DST end month
+ * (e.g., October to April in Australia)
+ * DST is active when: now >= start OR now < end
+ * This handles the year wrap (DST spans Dec 31/Jan 1)
+ * ========================================================================= */
 
-    for (i = 0; i < tz_table_count && city_count < MAX_CITIES; i++) {
-        if (str_equal(tz_table[i].region, region)) {
-            city_list[city_count++] = &tz_table[i];
-        }
-    }
+/*
+ * Helper: seconds to subtract from a rule's transition time to get UTC
+ *
+ * save_mins is the DST offset in effect just before the change: 0 for
+ * the start, dst_offset_mins for the end, so wall clock times are
+ * read in the time they are given in.
+ */
+static LONG rule_at_offset(UBYTE at, const TZEntry *tz, LONG save_mins)
+{
+    if (at == TZ_AT_UTC)
+        return 0;
+    if (at == TZ_AT_STD)
+        return (LONG)tz->std_offset_mins * SECS_PER_MIN;
+    return ((LONG)tz->std_offset_mins + save_mins) * SECS_PER_MIN;
+}
 
-    if (count)
-        *count = city_count;
+static BOOL dst_cache_active(const TZRule *rule, ULONG utc_secs)
+{
+    if (rule->dst_start_month < rule->dst_end_month)
+        return (utc_secs >= dst_cache_start && utc_secs < dst_cache_end);
 
-    return city_list;
+    return (utc_secs >= dst_cache_start || utc_secs < dst_cache_end);
 }
 
 /* =========================================================================
@@ -366,65 +679,72 @@ const TZEntry **tz_get_cities_for_region(const char *region, ULONG *count)
  * Handles both northern hemisphere (DST spring-fall) and southern
  * hemisphere (DST fall-spring wrapping year).
  *
+ * The transitions are worked out once per zone and year and cached,
+ * so repeated calls within the same year are two comparisons.
+ *
  * utc_secs is Amiga epoch seconds (since Jan 1, 1978).
  * Returns TRUE if DST is currently active, FALSE otherwise.
  * ========================================================================= */
 
 BOOL tz_is_dst_active(const TZEntry *tz, ULONG utc_secs)
 {
+    const TZRule *rule;
     LONG year;
-    UBYTE month, day, hour;
-    ULONG local_secs;
+    ULONG local_secs, offset_secs;
     UBYTE dst_start_day, dst_end_day;
-    ULONG dst_start_secs, dst_end_secs;
 
     if (!tz)
         return FALSE;
+    rule = tz_rule(tz);
 
     /* No DST if dst_start_month is 0 or dst_offset is 0 */
-    if (tz->dst_start_month == 0 || tz->dst_offset_mins == 0)
+    if (rule->dst_start_month == 0 || rule->dst_offset_mins == 0)
         return FALSE;
 
+    /* Fast path: same zone, same year as last time */
+    if (tz == dst_cache_zone &&
+        utc_secs >= dst_cache_year_start && utc_secs < dst_cache_year_end)
+        return dst_cache_active(rule, utc_secs);
+
     /* Convert UTC to local standard time for comparison */
     /* We add the standard offset (which may be negative for western zones) */
     if (tz->std_offset_mins >= 0) {
         local_secs = utc_secs + (ULONG)(tz->std_offset_mins * SECS_PER_MIN);
     } else {
-        ULONG offset_secs = (ULONG)((-tz->std_offset_mins) * SECS_PER_MIN);
+        offset_secs = (ULONG)((-tz->std_offset_mins) * SECS_PER_MIN);
         if (utc_secs < offset_secs)
             return FALSE;  /* Time too early to calculate DST */
         local_secs = utc_secs - offset_secs;
     }
 
-    /* Get current date/time components in local standard time */
-    amiga_secs_to_date(local_secs, &year, &month, &day, &hour);
+    /* Get the current year in local standard time */
+    cal_civil_from_days(local_secs / SECS_PER_DAY, &year, NULL, NULL);
 
     /* Calculate DST transition dates for this year */
-    dst_start_day = nth_dow_of_month(year, tz->dst_start_month,
-                                     tz->dst_start_week, tz->dst_start_dow);
-    dst_end_day = nth_dow_of_month(year, tz->dst_end_month,
-                                   tz->dst_end_week, tz->dst_end_dow);
-
-    /* Calculate transition times in local standard seconds since epoch */
-    dst_start_secs = date_to_amiga_secs(year, tz->dst_start_month,
-                                        dst_start_day, tz->dst_start_hour);
-    dst_end_secs = date_to_amiga_secs(year, tz->dst_end_month,
-                                      dst_end_day, tz->dst_end_hour);
-
-    /* Northern hemisphere: DST start month < DST end month
-     * (e.g., March to November in USA)
-     * DST is active when: start <= now < end
-     */
-    if (tz->dst_start_month < tz->dst_end_month) {
-        return (local_secs >= dst_start_secs && local_secs < dst_end_secs);
-    }
-
-    /* Southern hemisphere: DST start month > DST end month
-     * (e.g., October to April in Australia)
-     * DST is active when: now >= start OR now < end
-     * This handles the year wrap (DST spans Dec 31/Jan 1)
-     */
-    return (local_secs >= dst_start_secs || local_secs < dst_end_secs);
+    dst_start_day = nth_dow_of_month(year, rule->dst_start_month,
+                                     rule->dst_start_week, rule->dst_start_dow);
+    dst_end_day = nth_dow_of_month(year, rule->dst_end_month,
+                                   rule->dst_end_week, rule->dst_end_dow);
+
+    /* Convert the transition times (wall, standard or UTC, as the rule
+     * says) and the year bounds to UTC so later calls can compare
+     * utc_secs directly */
+    offset_secs = (ULONG)((LONG)tz->std_offset_mins * SECS_PER_MIN);
+
+    dst_cache_zone       = tz;
+    dst_cache_year_start = date_to_amiga_secs(year, 1, 1, 0) - offset_secs;
+    dst_cache_year_end   = date_to_amiga_secs(year + 1, 1, 1, 0) - offset_secs;
+    dst_cache_start      = date_to_amiga_secs(year, rule->dst_start_month,
+                                              dst_start_day, rule->dst_start_hour) +
+                           (ULONG)rule->dst_start_min * SECS_PER_MIN -
+                           (ULONG)rule_at_offset(rule->dst_start_at, tz, 0);
+    dst_cache_end        = date_to_amiga_secs(year, rule->dst_end_month,
+                                              dst_end_day, rule->dst_end_hour) +
+                           (ULONG)rule->dst_end_min * SECS_PER_MIN -
+                           (ULONG)rule_at_offset(rule->dst_end_at, tz,
+                                                 rule->dst_offset_mins);
+
+    return dst_cache_active(rule, utc_secs);
 }
 
 /* =========================================================================
@@ -440,11 +760,47 @@ LONG tz_get_offset_mins(const TZEntry *tz, ULONG utc_secs)
         return 0;
 
     if (tz_is_dst_active(tz, utc_secs))
-        return (LONG)tz->std_offset_mins + (LONG)tz->dst_offset_mins;
+        return (LONG)tz->std_offset_mins + (LONG)tz_rule(tz)->dst_offset_mins;
 
     return (LONG)tz->std_offset_mins;
 }
 
+/* =========================================================================
+ * tz_next_transition - Find the next DST change after a UTC time
+ *
+ * Looks at the transitions of utc_secs's year, then of the next one.
+ * Returns the UTC second at which tz_get_offset_mins() changes, or 0
+ * if the zone has no DST.
+ * ========================================================================= */
+
+ULONG tz_next_transition(const TZEntry *tz, ULONG utc_secs)
+{
+    const TZRule *rule;
+    ULONG next;
+    int i;
+
+    if (!tz)
+        return 0;
+    rule = tz_rule(tz);
+    if (rule->dst_start_month == 0 || rule->dst_offset_mins == 0)
+        return 0;
+
+    tz_is_dst_active(tz, utc_secs);
+    for (i = 0; i < 2 && dst_cache_zone == tz; i++) {
+        next = 0;
+        if (dst_cache_start > utc_secs)
+            next = dst_cache_start;
+        if (dst_cache_end > utc_secs && (next == 0 || dst_cache_end < next))
+            next = dst_cache_end;
+        if (next != 0)
+            return next;
+
+        tz_is_dst_active(tz, dst_cache_year_end);
+    }
+
+    return 0;
+}
+
 /* =========================================================================
  * Helper: append a number to a string buffer
  * ========================================================================= */
@@ -475,6 +831,38 @@ static char *append_num(char *p, LONG num)
     return p;
 }
 
+/* =========================================================================
+ * Helper: append a POSIX transition time unless it is the default 2:00
+ *
+ * POSIX times are wall clock time before the change, so the rule's
+ * hour is converted from what it is given in. save_mins as for
+ * rule_at_offset().
+ * ========================================================================= */
+
+static char *append_posix_time(char *p, UBYTE hour, UBYTE min, UBYTE at,
+                               const TZEntry *tz, LONG save_mins)
+{
+    LONG mins;
+
+    mins = (LONG)hour * 60 + min + (LONG)tz->std_offset_mins + save_mins -
+           rule_at_offset(at, tz, save_mins) / SECS_PER_MIN;
+    if (mins == 2 * 60)
+        return p;
+
+    *p++ = '/';
+    if (mins < 0) {
+        *p++ = '-';
+        mins = -mins;
+    }
+    p = append_num(p, mins / 60);
+    if (mins % 60 != 0) {
+        *p++ = ':';
+        if (mins % 60 < 10) *p++ = '0';
+        p = append_num(p, mins % 60);
+    }
+    return p;
+}
+
 /* =========================================================================
  * tz_set_env - Set TZ and TZONE environment variables
  *
@@ -487,6 +875,7 @@ static char *append_num(char *p, LONG num)
 
 BOOL tz_set_env(const TZEntry *tz)
 {
+    const TZRule *rule;
     char tz_buf[80];
     char *p;
     LONG offset_hours, offset_mins_rem;
@@ -494,6 +883,7 @@ BOOL tz_set_env(const TZEntry *tz)
 
     if (!tz)
         return FALSE;
+    rule = tz_rule(tz);
 
     p = tz_buf;
 
@@ -523,13 +913,13 @@ BOOL tz_set_env(const TZEntry *tz)
     }
 
     /* Add DST info if applicable */
-    if (tz->dst_offset_mins > 0 && tz->dst_start_month > 0) {
+    if (rule->dst_offset_mins > 0 && rule->dst_start_month > 0) {
         /* DST abbreviation */
         *p++ = 'D'; *p++ = 'S'; *p++ = 'T';
 
         /* DST offset (total offset during DST) */
-        dst_offset_hours = -((tz->std_offset_mins + tz->dst_offset_mins) / 60);
-        dst_offset_mins_rem = (tz->std_offset_mins + tz->dst_offset_mins) % 60;
+        dst_offset_hours = -((tz->std_offset_mins + rule->dst_offset_mins) / 60);
+        dst_offset_mins_rem = (tz->std_offset_mins + rule->dst_offset_mins) % 60;
         if (dst_offset_mins_rem < 0) dst_offset_mins_rem = -dst_offset_mins_rem;
 
         p = append_num(p, dst_offset_hours);
@@ -542,32 +932,28 @@ BOOL tz_set_env(const TZEntry *tz)
         /* DST start rule: M<month>.<week>.<dow> */
         *p++ = ',';
         *p++ = 'M';
-        p = append_num(p, tz->dst_start_month);
+        p = append_num(p, rule->dst_start_month);
         *p++ = '.';
-        p = append_num(p, tz->dst_start_week);
+        p = append_num(p, rule->dst_start_week);
         *p++ = '.';
-        p = append_num(p, tz->dst_start_dow);
+        p = append_num(p, rule->dst_start_dow);
 
         /* DST start time if not 2:00 AM */
-        if (tz->dst_start_hour != 2) {
-            *p++ = '/';
-            p = append_num(p, tz->dst_start_hour);
-        }
+        p = append_posix_time(p, rule->dst_start_hour, rule->dst_start_min,
+                              rule->dst_start_at, tz, 0);
 
         /* DST end rule */
         *p++ = ',';
         *p++ = 'M';
-        p = append_num(p, tz->dst_end_month);
+        p = append_num(p, rule->dst_end_month);
         *p++ = '.';
-        p = append_num(p, tz->dst_end_week);
+        p = append_num(p, rule->dst_end_week);
         *p++ = '.';
-        p = append_num(p, tz->dst_end_dow);
+        p = append_num(p, rule->dst_end_dow);
 
         /* DST end time if not 2:00 AM */
-        if (tz->dst_end_hour != 2) {
-            *p++ = '/';
-            p = append_num(p, tz->dst_end_hour);
-        }
+        p = append_posix_time(p, rule->dst_end_hour, rule->dst_end_min,
+                              rule->dst_end_at, tz, rule->dst_offset_mins);
     }
 
     *p = '\0';
@@ -577,7 +963,7 @@ BOOL tz_set_env(const TZEntry *tz)
         return FALSE;
 
     /* Set TZONE to the full IANA name */
-    if (!SetVar("TZONE", (STRPTR)tz->name, -1, GVF_GLOBAL_ONLY))
+    if (!SetVar("TZONE", (STRPTR)tz_name(tz), -1, GVF_GLOBAL_ONLY))
         return FALSE;
 
     return TRUE;
@@ -6,6 +6,18 @@
  * Opened via Exchange "Show" or the commodity hotkey.
  *
  * Log is displayed in a separate window.
+ *
+ * intuition, graphics, gadtools and the Reaction classes are opened
+ * when the window is first shown, not at startup, and closed again
+ * once the window has stayed hidden for GUI_EXPIRE_SECS.
+ *
+ * The city list keeps one node list per region for as long as the
+ * window is open, so switching regions only swaps lists. Typing in the
+ * Search field lists every zone whose name contains the text instead,
+ * matched against a folded copy of all names built on the first
+ * keystroke; the match nodes are reused from one keystroke to the
+ * next. The field is polled on IntuiTicks, so the list follows typing
+ * without waiting for Return.
  */
 
 #include "synctime.h"
@@ -51,15 +63,18 @@
 #define GID_HIDE        11
 #define GID_LOG_TOGGLE  12
 #define GID_LOG         13
+#define GID_STATS       14
+#define GID_SEARCH      15
 
-/* Log system - circular buffer with 2KB limit
- * With max 80 chars per line, 2048/80 = ~25 entries max */
+/* Log system - fixed ring of 80-byte lines within 2KB
+ * 2048/80 = 25 entries; the oldest line is overwritten when full */
 #define LOG_MAX_BYTES   2048
 #define LOG_LINE_LEN    80
 #define LOG_MAX_ENTRIES (LOG_MAX_BYTES / LOG_LINE_LEN)
 
-/* Maximum regions for chooser */
-#define MAX_REGIONS     20
+/* Seconds the window must stay hidden before the GUI libraries are
+ * closed again (checked after each sync) */
+#define GUI_EXPIRE_SECS 600
 
 /* =========================================================================
  * Static module state - Main window
@@ -73,11 +88,13 @@ static struct Window *win = NULL;
 static Object *gad_status    = NULL;
 static Object *gad_last_sync = NULL;
 static Object *gad_next_sync = NULL;
+static Object *gad_stats     = NULL;
 static Object *gad_server    = NULL;
 static Object *gad_interval  = NULL;
 static Object *gad_region    = NULL;
 static Object *gad_city      = NULL;
 static Object *gad_tz_info   = NULL;
+static Object *gad_search    = NULL;
 static Object *gad_log_toggle = NULL;
 
 /* Layout objects */
@@ -86,7 +103,7 @@ static Object *layout_root   = NULL;
 /* Timezone selection state */
 static ULONG current_region_idx = 0;
 static ULONG current_city_idx = 0;
-static const TZEntry **current_cities = NULL;
+static const TZEntry *current_cities = NULL;
 static ULONG current_city_count = 0;
 
 /* =========================================================================
@@ -101,22 +118,158 @@ static Object *gad_log = NULL;
 static struct List region_chooser_list;
 static BOOL region_list_initialized = FALSE;
 
-/* ListBrowser list for cities */
-static struct List city_browser_list;
-static BOOL city_list_initialized = FALSE;
+/* ListBrowser lists for cities, one per region, built when the region
+ * is first shown and kept until the window closes */
+typedef struct {
+    struct List    nodes;
+    const TZEntry *cities;
+    ULONG          count;
+    BOOL           built;
+} RegionCities;
+
+static RegionCities *region_cities = NULL;   /* [region_cities_count] */
+static ULONG region_cities_count = 0;
+
+/* Search index: every zone name folded to lower case with '_' as a
+ * space, built on the first keystroke */
+#define SEARCH_MAX      32
+
+typedef struct {
+    const TZEntry *zone;
+    const char    *folded;   /* Points into search_pool */
+    UWORD          region;
+} SearchEntry;
+
+static SearchEntry *search_index = NULL;
+static const SearchEntry **search_hits = NULL;  /* Matches, in list order */
+static char  *search_pool = NULL;
+static ULONG  search_count = 0;
+static ULONG  search_hit_count = 0;
+static struct List search_list;      /* Nodes of the matches shown */
+static struct List search_spare;     /* Nodes to reuse */
+static BOOL   search_lists_initialized = FALSE;
+static BOOL   searching = FALSE;     /* City list shows search_list */
+static char   search_text[SEARCH_MAX] = "";  /* Folded, as last applied */
+
+/* Log lines - ring buffer, kept while the windows are closed */
+static char log_ring[LOG_MAX_ENTRIES][LOG_LINE_LEN];
+static LONG log_first = 0;  /* Slot of the oldest line */
+static LONG log_count = 0;
 
-/* ListBrowser list for log - circular buffer */
+/* ListBrowser list for log - only exists while the log window is open;
+ * node texts point into log_ring */
 static struct List log_browser_list;
-static BOOL log_list_initialized = FALSE;
-static LONG log_count = 0;
-static LONG log_bytes_used = 0;  /* Track total bytes for 2KB limit */
 
 /* Buffer for text displays */
 static char status_buf[64] = "Idle";
 static char last_sync_buf[32] = "Never";
 static char next_sync_buf[32] = "Pending";
+static char stats_buf[64] = "No syncs yet";
 static char tz_info_buf[64] = "UTC";
 
+/* Text display buffers changed since the gadgets were last updated;
+ * applied together by window_refresh() */
+#define DIRTY_STATUS    0x01
+#define DIRTY_LAST_SYNC 0x02
+#define DIRTY_NEXT_SYNC 0x04
+#define DIRTY_TZ_INFO   0x08
+#define DIRTY_STATS     0x10
+
+static UBYTE dirty_fields = 0;
+
+/* GUI libraries */
+static BOOL  gui_libs_open = FALSE;
+static ULONG gui_hidden_secs = 0;  /* When the window was last closed */
+
+/* =========================================================================
+ * GUI libraries - opened on demand
+ * ========================================================================= */
+
+static void close_gui_libraries(void)
+{
+    /* Reaction classes first (reverse order of opening) */
+    if (LabelBase != NULL) {
+        CloseLibrary(LabelBase);
+        LabelBase = NULL;
+    }
+    if (ListBrowserBase != NULL) {
+        CloseLibrary(ListBrowserBase);
+        ListBrowserBase = NULL;
+    }
+    if (ChooserBase != NULL) {
+        CloseLibrary(ChooserBase);
+        ChooserBase = NULL;
+    }
+    if (IntegerBase != NULL) {
+        CloseLibrary(IntegerBase);
+        IntegerBase = NULL;
+    }
+    if (StringBase != NULL) {
+        CloseLibrary(StringBase);
+        StringBase = NULL;
+    }
+    if (ButtonBase != NULL) {
+        CloseLibrary(ButtonBase);
+        ButtonBase = NULL;
+    }
+    if (LayoutBase != NULL) {
+        CloseLibrary(LayoutBase);
+        LayoutBase = NULL;
+    }
+    if (WindowBase != NULL) {
+        CloseLibrary(WindowBase);
+        WindowBase = NULL;
+    }
+
+    if (GadToolsBase != NULL) {
+        CloseLibrary(GadToolsBase);
+        GadToolsBase = NULL;
+    }
+    if (GfxBase != NULL) {
+        CloseLibrary((struct Library *)GfxBase);
+        GfxBase = NULL;
+    }
+    if (IntuitionBase != NULL) {
+        CloseLibrary((struct Library *)IntuitionBase);
+        IntuitionBase = NULL;
+    }
+
+    gui_libs_open = FALSE;
+}
+
+/* Open everything the windows need; on failure nothing stays open */
+static BOOL open_gui_libraries(void)
+{
+    if (gui_libs_open)
+        return TRUE;
+
+    IntuitionBase = (struct IntuitionBase *)OpenLibrary("intuition.library",
+                                                        LIB_VERSION);
+    GfxBase = (struct GfxBase *)OpenLibrary("graphics.library", LIB_VERSION);
+    GadToolsBase = OpenLibrary("gadtools.library", LIB_VERSION);
+
+    /* Reaction classes */
+    WindowBase = OpenLibrary("window.class", LIB_VERSION);
+    LayoutBase = OpenLibrary("gadgets/layout.gadget", LIB_VERSION);
+    ButtonBase = OpenLibrary("gadgets/button.gadget", LIB_VERSION);
+    StringBase = OpenLibrary("gadgets/string.gadget", LIB_VERSION);
+    IntegerBase = OpenLibrary("gadgets/integer.gadget", LIB_VERSION);
+    ChooserBase = OpenLibrary("gadgets/chooser.gadget", LIB_VERSION);
+    ListBrowserBase = OpenLibrary("gadgets/listbrowser.gadget", LIB_VERSION);
+    LabelBase = OpenLibrary("images/label.image", LIB_VERSION);
+
+    if (IntuitionBase == NULL || GfxBase == NULL || GadToolsBase == NULL ||
+        WindowBase == NULL || LayoutBase == NULL || ButtonBase == NULL ||
+        StringBase == NULL || IntegerBase == NULL || ChooserBase == NULL ||
+        ListBrowserBase == NULL || LabelBase == NULL) {
+        close_gui_libraries();
+        return FALSE;
+    }
+
+    gui_libs_open = TRUE;
+    return TRUE;
+}
+
 /* =========================================================================
  * Helper functions for Chooser/ListBrowser list management
  * ========================================================================= */
@@ -142,7 +295,7 @@ static void free_listbrowser_list(struct List *list)
 /* Build the region chooser list */
 static void build_region_chooser_list(void)
 {
-    const char **regions;
+    const char *const *regions;
     ULONG region_count, i;
     struct Node *node;
 
@@ -154,7 +307,7 @@ static void build_region_chooser_list(void)
     }
 
     regions = tz_get_regions(&region_count);
-    for (i = 0; i < region_count && i < MAX_REGIONS; i++) {
+    for (i = 0; i < region_count; i++) {
         node = AllocChooserNode(CNA_Text, (ULONG)regions[i], TAG_DONE);
         if (node) {
             AddTail(&region_chooser_list, node);
@@ -162,39 +315,255 @@ static void build_region_chooser_list(void)
     }
 }
 
-/* Build the city listbrowser list for a given region */
-static void build_city_browser_list(const char *region)
+/* Set up the per-region city list cache for the window */
+static BOOL init_region_cities(void)
+{
+    ULONG i;
+
+    tz_get_regions(&region_cities_count);
+    if (region_cities_count == 0)
+        return TRUE;
+
+    region_cities = (RegionCities *)AllocVec(region_cities_count * sizeof(RegionCities),
+                                             MEMF_ANY | MEMF_CLEAR);
+    if (!region_cities) {
+        region_cities_count = 0;
+        return FALSE;
+    }
+
+    for (i = 0; i < region_cities_count; i++)
+        NewList(&region_cities[i].nodes);
+    return TRUE;
+}
+
+/* Free every cached city list */
+static void free_region_cities(void)
 {
     ULONG i;
+
+    if (!region_cities)
+        return;
+
+    for (i = 0; i < region_cities_count; i++)
+        free_listbrowser_list(&region_cities[i].nodes);
+    FreeVec(region_cities);
+    region_cities = NULL;
+    region_cities_count = 0;
+}
+
+/* Make a region's city list current, building it the first time */
+static struct List *region_city_list(ULONG region)
+{
+    const char *const *regions;
+    RegionCities *rc;
     struct Node *node;
+    ULONG count, i;
+
+    regions = tz_get_regions(&count);
+    if (!region_cities || region >= region_cities_count || region >= count)
+        return NULL;
+
+    rc = &region_cities[region];
+    if (!rc->built) {
+        rc->cities = tz_get_cities_for_region(regions[region], &rc->count);
+        for (i = 0; i < rc->count; i++) {
+            node = AllocListBrowserNode(1,
+                LBNA_Column, 0,
+                LBNCA_Text, (ULONG)tz_city(&rc->cities[i]),
+                TAG_DONE);
+            if (node) {
+                AddTail(&rc->nodes, node);
+            }
+        }
+        rc->built = TRUE;
+    }
 
-    if (!city_list_initialized) {
-        NewList(&city_browser_list);
-        city_list_initialized = TRUE;
-    } else {
-        free_listbrowser_list(&city_browser_list);
+    current_cities = rc->cities;
+    current_city_count = rc->count;
+    return &rc->nodes;
+}
+
+/* Zone shown at a city list position */
+static const TZEntry *shown_zone(ULONG idx)
+{
+    if (searching)
+        return (idx < search_hit_count) ? search_hits[idx]->zone : NULL;
+    return (idx < current_city_count) ? &current_cities[idx] : NULL;
+}
+
+/* Copy text folded for searching: lower case, '_' as a space */
+static char *fold_name(char *dst, const char *src, LONG max)
+{
+    char c;
+
+    while (max-- > 1 && (c = *src++) != '\0') {
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        else if (c == '_')
+            c = ' ';
+        *dst++ = c;
     }
+    *dst++ = '\0';
+    return dst;
+}
 
-    current_cities = tz_get_cities_for_region(region, &current_city_count);
-    for (i = 0; i < current_city_count; i++) {
-        node = AllocListBrowserNode(1,
-            LBNA_Column, 0,
-            LBNCA_Text, (ULONG)current_cities[i]->city,
-            TAG_DONE);
+/* TRUE if folded text contains folded needle */
+static BOOL folded_contains(const char *text, const char *needle)
+{
+    const char *t, *n;
+
+    for (; *text != '\0'; text++) {
+        if (*text != *needle)
+            continue;
+        for (t = text, n = needle; *n != '\0' && *t == *n; t++, n++)
+            ;
+        if (*n == '\0')
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Build the search index over every zone of every region */
+static BOOL build_search_index(void)
+{
+    const char *const *regions;
+    const TZEntry *cities;
+    ULONG region_count, count, r, i, pool_size = 0;
+    char *p;
+
+    if (search_index)
+        return TRUE;
+
+    regions = tz_get_regions(&region_count);
+    search_count = 0;
+    for (r = 0; r < region_count; r++) {
+        cities = tz_get_cities_for_region(regions[r], &count);
+        for (i = 0; i < count; i++)
+            pool_size += strlen(tz_name(&cities[i])) + 1;
+        search_count += count;
+    }
+    if (search_count == 0)
+        return FALSE;
+
+    search_index = (SearchEntry *)AllocVec(search_count * sizeof(SearchEntry), MEMF_ANY);
+    search_hits = (const SearchEntry **)AllocVec(search_count * sizeof(SearchEntry *),
+                                                 MEMF_ANY);
+    search_pool = (char *)AllocVec(pool_size, MEMF_ANY);
+    if (!search_index || !search_hits || !search_pool) {
+        if (search_index) FreeVec(search_index);
+        if (search_hits) FreeVec(search_hits);
+        if (search_pool) FreeVec(search_pool);
+        search_index = NULL;
+        search_hits = NULL;
+        search_pool = NULL;
+        search_count = 0;
+        return FALSE;
+    }
+
+    p = search_pool;
+    search_count = 0;
+    for (r = 0; r < region_count; r++) {
+        cities = tz_get_cities_for_region(regions[r], &count);
+        for (i = 0; i < count; i++) {
+            search_index[search_count].zone   = &cities[i];
+            search_index[search_count].folded = p;
+            search_index[search_count].region = (UWORD)r;
+            p = fold_name(p, tz_name(&cities[i]), pool_size - (ULONG)(p - search_pool));
+            search_count++;
+        }
+    }
+    return TRUE;
+}
+
+/* Free the search index and the match nodes */
+static void free_search(void)
+{
+    if (search_lists_initialized) {
+        free_listbrowser_list(&search_list);
+        free_listbrowser_list(&search_spare);
+        search_lists_initialized = FALSE;
+    }
+    if (search_index) FreeVec(search_index);
+    if (search_hits) FreeVec(search_hits);
+    if (search_pool) FreeVec(search_pool);
+    search_index = NULL;
+    search_hits = NULL;
+    search_pool = NULL;
+    search_count = 0;
+    search_hit_count = 0;
+    searching = FALSE;
+    search_text[0] = '\0';
+}
+
+/* Fill search_list with the zones matching folded, reusing nodes */
+static void collect_matches(const char *folded)
+{
+    struct Node *node;
+    ULONG i;
+
+    if (!search_lists_initialized) {
+        NewList(&search_list);
+        NewList(&search_spare);
+        search_lists_initialized = TRUE;
+    }
+
+    while ((node = RemHead(&search_list)) != NULL)
+        AddTail(&search_spare, node);
+
+    search_hit_count = 0;
+    for (i = 0; i < search_count; i++) {
+        if (!folded_contains(search_index[i].folded, folded))
+            continue;
+
+        node = RemHead(&search_spare);
         if (node) {
-            AddTail(&city_browser_list, node);
+            SetListBrowserNodeAttrs(node,
+                LBNCA_Text, (ULONG)tz_name(search_index[i].zone),
+                TAG_DONE);
+        } else {
+            node = AllocListBrowserNode(1,
+                LBNA_Column, 0,
+                LBNCA_Text, (ULONG)tz_name(search_index[i].zone),
+                TAG_DONE);
+            if (!node)
+                break;
         }
+        AddTail(&search_list, node);
+        search_hits[search_hit_count++] = &search_index[i];
+    }
+}
+
+/* Add a log listbrowser node showing one ring slot */
+static void add_log_node(const char *text)
+{
+    struct Node *node;
+
+    node = AllocListBrowserNode(1,
+        LBNA_Column, 0,
+        LBNCA_Text, (ULONG)text,
+        TAG_DONE);
+    if (node) {
+        AddTail(&log_browser_list, node);
     }
 }
 
-/* Initialize log list */
-static void init_log_list(void)
+/* Build the log listbrowser list from the ring, oldest line first */
+static void build_log_browser_list(void)
 {
-    if (!log_list_initialized) {
-        NewList(&log_browser_list);
-        log_list_initialized = TRUE;
-        log_count = 0;
-        log_bytes_used = 0;
+    LONG i;
+
+    NewList(&log_browser_list);
+    for (i = 0; i < log_count; i++) {
+        add_log_node(log_ring[(log_first + i) % LOG_MAX_ENTRIES]);
+    }
+}
+
+/* Copy text into a display buffer, marking the field dirty if it changed */
+static void set_field_text(char *buf, const char *text, UBYTE field)
+{
+    if (strcmp(buf, text) != 0) {
+        strcpy(buf, text);
+        dirty_fields |= field;
     }
 }
 
@@ -202,11 +571,12 @@ static void init_log_list(void)
 static void format_tz_info(const TZEntry *tz)
 {
     LONG offset_mins_rem, offset_hrs;
+    char info[sizeof(tz_info_buf)];
     char sign;
     char *p;
 
     if (tz == NULL) {
-        strcpy(tz_info_buf, "UTC");
+        set_field_text(tz_info_buf, "UTC", DIRTY_TZ_INFO);
         return;
     }
 
@@ -216,7 +586,7 @@ static void format_tz_info(const TZEntry *tz)
     offset_hrs = offset_mins_rem / 60;
     offset_mins_rem = offset_mins_rem % 60;
 
-    p = tz_info_buf;
+    p = info;
 
     /* Build "UTC+X" or "UTC+X:MM" */
     *p++ = 'U'; *p++ = 'T'; *p++ = 'C'; *p++ = sign;
@@ -234,11 +604,13 @@ static void format_tz_info(const TZEntry *tz)
     }
 
     /* Add DST info */
-    if (tz->dst_offset_mins > 0) {
+    if (tz_rule(tz)->dst_offset_mins > 0) {
         strcpy(p, ", DST active seasonally");
     } else {
         strcpy(p, " (no DST)");
     }
+
+    set_field_text(tz_info_buf, info, DIRTY_TZ_INFO);
 }
 
 /* =========================================================================
@@ -291,8 +663,6 @@ static void log_window_open(void)
     if (log_window_obj)
         return;  /* Already open */
 
-    init_log_list();
-
     /* Calculate log window position and size based on main window */
     if (win) {
         log_left = win->LeftEdge;
@@ -308,6 +678,7 @@ static void log_window_open(void)
     }
 
     /* Create log listbrowser */
+    build_log_browser_list();
     gad_log = NewObject(LISTBROWSER_GetClass(), NULL,
         GA_ID, GID_LOG,
         GA_ReadOnly, TRUE,
@@ -315,8 +686,10 @@ static void log_window_open(void)
         LISTBROWSER_AutoFit, TRUE,
         TAG_DONE);
 
-    if (!gad_log)
+    if (!gad_log) {
+        free_listbrowser_list(&log_browser_list);
         return;
+    }
 
     /* Create log layout */
     log_layout = NewObject(LAYOUT_GetClass(), NULL,
@@ -328,6 +701,7 @@ static void log_window_open(void)
     if (!log_layout) {
         DisposeObject(gad_log);
         gad_log = NULL;
+        free_listbrowser_list(&log_browser_list);
         return;
     }
 
@@ -350,6 +724,7 @@ static void log_window_open(void)
     if (!log_window_obj) {
         DisposeObject(log_layout);
         gad_log = NULL;
+        free_listbrowser_list(&log_browser_list);
         return;
     }
 
@@ -359,6 +734,7 @@ static void log_window_open(void)
         DisposeObject(log_window_obj);
         log_window_obj = NULL;
         gad_log = NULL;
+        free_listbrowser_list(&log_browser_list);
         return;
     }
 
@@ -392,6 +768,7 @@ static void log_window_close(void)
     if (log_window_obj) {
         DisposeObject(log_window_obj);
         log_window_obj = NULL;
+        free_listbrowser_list(&log_browser_list);
     }
     gad_log = NULL;
 
@@ -443,18 +820,21 @@ static BOOL log_window_handle_events(void)
 BOOL window_open(struct Screen *screen)
 {
     SyncConfig *cfg;
-    const char **regions;
+    const char *const *regions;
     ULONG region_count, i;
     const TZEntry *tz;
     Object *status_group, *settings_group, *timezone_group, *button_row;
     Object *row;
-
-    /* Initialize log list if needed */
-    init_log_list();
+    struct List *city_list;
 
     if (window_obj)
         return TRUE;   /* Already open */
 
+    if (!open_gui_libraries()) {
+        log_msg(LOG_ERROR, "ERROR: Failed to open GUI libraries");
+        return FALSE;
+    }
+
     /* Lock the public screen for proper font settings */
     if (screen) {
         pub_screen = screen;
@@ -470,19 +850,23 @@ BOOL window_open(struct Screen *screen)
     /* Find current timezone in table and set up region/city indices */
     regions = tz_get_regions(&region_count);
     tz = tz_find_by_name(cfg->tz_name);
+    city_list = NULL;
+    if (!init_region_cities())
+        goto cleanup;
 
     if (tz) {
         /* Find region index */
         for (i = 0; i < region_count; i++) {
-            if (strcmp(regions[i], tz->region) == 0) {
+            if (strcmp(regions[i], tz_region(tz)) == 0) {
                 current_region_idx = i;
                 break;
             }
         }
+
         /* Build city list and find city index */
-        build_city_browser_list(tz->region);
+        city_list = region_city_list(current_region_idx);
         for (i = 0; i < current_city_count; i++) {
-            if (strcmp(current_cities[i]->name, cfg->tz_name) == 0) {
+            if (strcmp(tz_name(&current_cities[i]), cfg->tz_name) == 0) {
                 current_city_idx = i;
                 break;
             }
@@ -490,9 +874,7 @@ BOOL window_open(struct Screen *screen)
         format_tz_info(tz);
     } else {
         current_region_idx = 0;
-        if (region_count > 0) {
-            build_city_browser_list(regions[0]);
-        }
+        city_list = region_city_list(0);
         current_city_idx = 0;
         format_tz_info(NULL);
     }
@@ -504,8 +886,9 @@ BOOL window_open(struct Screen *screen)
     gad_status = create_display_string(GID_STATUS, status_buf);
     gad_last_sync = create_display_string(GID_LAST_SYNC, last_sync_buf);
     gad_next_sync = create_display_string(GID_NEXT_SYNC, next_sync_buf);
+    gad_stats = create_display_string(GID_STATS, stats_buf);
 
-    if (!gad_status || !gad_last_sync || !gad_next_sync)
+    if (!gad_status || !gad_last_sync || !gad_next_sync || !gad_stats)
         goto cleanup;
 
     /* Create status group */
@@ -517,6 +900,7 @@ BOOL window_open(struct Screen *screen)
         LAYOUT_AddChild, (ULONG)create_label_row("Status:", gad_status),
         LAYOUT_AddChild, (ULONG)create_label_row("Last sync:", gad_last_sync),
         LAYOUT_AddChild, (ULONG)create_label_row("Next sync:", gad_next_sync),
+        LAYOUT_AddChild, (ULONG)create_label_row("Statistics:", gad_stats),
         TAG_DONE);
 
     if (!status_group)
@@ -565,16 +949,24 @@ BOOL window_open(struct Screen *screen)
     gad_city = NewObject(LISTBROWSER_GetClass(), NULL,
         GA_ID, GID_CITY,
         GA_RelVerify, TRUE,
-        LISTBROWSER_Labels, (ULONG)&city_browser_list,
+        LISTBROWSER_Labels, (ULONG)city_list,
         LISTBROWSER_Selected, current_city_idx,
         LISTBROWSER_ShowSelected, TRUE,
         LISTBROWSER_AutoFit, TRUE,
         TAG_DONE);
 
+    /* Create zone search field */
+    gad_search = NewObject(STRING_GetClass(), NULL,
+        GA_ID, GID_SEARCH,
+        GA_RelVerify, TRUE,
+        STRINGA_TextVal, (ULONG)"",
+        STRINGA_MaxChars, SEARCH_MAX - 1,
+        TAG_DONE);
+
     /* Create TZ info display */
     gad_tz_info = create_display_string(GID_TZ_INFO, tz_info_buf);
 
-    if (!gad_region || !gad_city || !gad_tz_info)
+    if (!gad_region || !gad_search || !gad_city || !gad_tz_info)
         goto cleanup;
 
     /* Create city row */
@@ -593,6 +985,8 @@ BOOL window_open(struct Screen *screen)
         LAYOUT_SpaceOuter, TRUE,
         LAYOUT_AddChild, (ULONG)create_label_row("Region:", gad_region),
         CHILD_WeightedHeight, 0,
+        LAYOUT_AddChild, (ULONG)create_label_row("Search:", gad_search),
+        CHILD_WeightedHeight, 0,
         LAYOUT_AddChild, (ULONG)row,
         CHILD_MinHeight, 80,
         LAYOUT_AddChild, (ULONG)gad_tz_info,
@@ -660,6 +1054,7 @@ BOOL window_open(struct Screen *screen)
         WA_CloseGadget, TRUE,
         WA_DepthGadget, TRUE,
         WA_Activate, TRUE,
+        WA_IDCMP, IDCMP_GADGETUP | IDCMP_CLOSEWINDOW | IDCMP_INTUITICKS,
         WINDOW_Position, WPOS_CENTERSCREEN,
         WINDOW_ParentGroup, (ULONG)layout_root,
         TAG_DONE);
@@ -675,6 +1070,9 @@ BOOL window_open(struct Screen *screen)
         return FALSE;
     }
 
+    /* Gadgets were created from the current buffers */
+    dirty_fields = 0;
+
     /* Scroll city list to show selected item near top (with 1 item of context) */
     if (gad_city && current_city_idx > 0) {
         LONG top_idx = (LONG)current_city_idx - 1;
@@ -694,10 +1092,11 @@ cleanup:
         UnlockPubScreen(NULL, pub_screen);
         pub_screen = NULL;
     }
+    free_region_cities();
     layout_root = NULL;
-    gad_status = gad_last_sync = gad_next_sync = NULL;
+    gad_status = gad_last_sync = gad_next_sync = gad_stats = NULL;
     gad_server = gad_interval = NULL;
-    gad_region = gad_city = gad_tz_info = NULL;
+    gad_region = gad_city = gad_tz_info = gad_search = NULL;
     gad_log_toggle = NULL;
     return FALSE;
 }
@@ -708,6 +1107,12 @@ cleanup:
 
 void window_close(void)
 {
+    ULONG micro;
+
+    /* Start the countdown to closing the GUI libraries */
+    if (win)
+        clock_get_system_time(&gui_hidden_secs, &micro);
+
     /* Close log window first */
     log_window_close();
 
@@ -739,11 +1144,9 @@ void window_close(void)
         free_chooser_list(&region_chooser_list);
         region_list_initialized = FALSE;
     }
-    if (city_list_initialized) {
-        free_listbrowser_list(&city_browser_list);
-        city_list_initialized = FALSE;
-    }
-    /* Note: log list is preserved across window open/close */
+    free_region_cities();
+    free_search();
+    /* Note: log lines are preserved across window open/close */
 
     /* Unlock the public screen */
     if (pub_screen) {
@@ -751,11 +1154,14 @@ void window_close(void)
         pub_screen = NULL;
     }
 
+    /* Settings saved while the window was open go to ENVARC: now */
+    config_flush();
+
     /* Reset object pointers */
     layout_root = NULL;
-    gad_status = gad_last_sync = gad_next_sync = NULL;
+    gad_status = gad_last_sync = gad_next_sync = gad_stats = NULL;
     gad_server = gad_interval = NULL;
-    gad_region = gad_city = gad_tz_info = NULL;
+    gad_region = gad_city = gad_tz_info = gad_search = NULL;
     gad_log_toggle = NULL;
 }
 
@@ -790,37 +1196,39 @@ ULONG window_signal(void)
 
 static void handle_region_change(ULONG new_region)
 {
-    const char **regions;
-    ULONG region_count;
-
-    regions = tz_get_regions(&region_count);
-    if (new_region >= region_count)
-        return;
-
-    current_region_idx = new_region;
+    struct List *list;
 
-    /* Detach list from gadget before modifying */
+    /* Detach list from gadget before switching */
     SetGadgetAttrs((struct Gadget *)gad_city, win, NULL,
         LISTBROWSER_Labels, (ULONG)~0,
         TAG_DONE);
 
-    /* Rebuild city list */
-    build_city_browser_list(regions[new_region]);
-    current_city_idx = 0;
+    list = region_city_list(new_region);
+    if (list) {
+        current_region_idx = new_region;
+        current_city_idx = 0;
+
+        /* Picking a region ends a search */
+        if (searching) {
+            searching = FALSE;
+            search_text[0] = '\0';
+            SetGadgetAttrs((struct Gadget *)gad_search, win, NULL,
+                STRINGA_TextVal, (ULONG)"",
+                TAG_DONE);
+        }
+    } else {
+        list = searching ? &search_list : region_city_list(current_region_idx);
+    }
 
     /* Reattach list */
     SetGadgetAttrs((struct Gadget *)gad_city, win, NULL,
-        LISTBROWSER_Labels, (ULONG)&city_browser_list,
-        LISTBROWSER_Selected, 0,
+        LISTBROWSER_Labels, (ULONG)list,
+        LISTBROWSER_Selected, current_city_idx,
         TAG_DONE);
 
     /* Update TZ info */
-    if (current_city_count > 0) {
-        format_tz_info(current_cities[0]);
-        SetGadgetAttrs((struct Gadget *)gad_tz_info, win, NULL,
-            STRINGA_TextVal, (ULONG)tz_info_buf,
-            TAG_DONE);
-    }
+    if (shown_zone(current_city_idx))
+        format_tz_info(shown_zone(current_city_idx));
 }
 
 /* =========================================================================
@@ -829,14 +1237,91 @@ static void handle_region_change(ULONG new_region)
 
 static void handle_city_change(ULONG new_city)
 {
-    if (new_city >= current_city_count)
+    const TZEntry *zone = shown_zone(new_city);
+
+    if (!zone)
         return;
 
     current_city_idx = new_city;
-    format_tz_info(current_cities[new_city]);
-    SetGadgetAttrs((struct Gadget *)gad_tz_info, win, NULL,
-        STRINGA_TextVal, (ULONG)tz_info_buf,
+    format_tz_info(zone);
+
+    /* A search hit may be in another region; show that one in the chooser */
+    if (searching && search_hits[new_city]->region != current_region_idx) {
+        current_region_idx = search_hits[new_city]->region;
+        SetGadgetAttrs((struct Gadget *)gad_region, win, NULL,
+            CHOOSER_Selected, current_region_idx,
+            TAG_DONE);
+    }
+}
+
+/* =========================================================================
+ * Helper: apply_search -- list the zones matching the search text
+ *
+ * An empty text, or one the index can't be built for, goes back to the
+ * current region's list.
+ * ========================================================================= */
+
+static void apply_search(const char *folded)
+{
+    const TZEntry *selected = shown_zone(current_city_idx);
+    struct List *list;
+    ULONG i;
+
+    /* Detach list from gadget before modifying */
+    SetGadgetAttrs((struct Gadget *)gad_city, win, NULL,
+        LISTBROWSER_Labels, (ULONG)~0,
+        TAG_DONE);
+
+    if (folded[0] != '\0' && build_search_index()) {
+        collect_matches(folded);
+        searching = TRUE;
+        list = &search_list;
+        current_city_idx = 0;
+    } else {
+        /* Back in the region list, keep the zone picked from the hits */
+        searching = FALSE;
+        list = region_city_list(current_region_idx);
+        current_city_idx = 0;
+        for (i = 0; selected && i < current_city_count; i++) {
+            if (&current_cities[i] == selected) {
+                current_city_idx = i;
+                break;
+            }
+        }
+    }
+
+    /* Reattach list */
+    SetGadgetAttrs((struct Gadget *)gad_city, win, NULL,
+        LISTBROWSER_Labels, (ULONG)list,
+        LISTBROWSER_Selected, current_city_idx,
+        LISTBROWSER_MakeVisible, current_city_idx,
         TAG_DONE);
+
+    if (shown_zone(current_city_idx))
+        handle_city_change(current_city_idx);
+}
+
+/* =========================================================================
+ * Helper: poll_search -- follow the search field as it is typed in
+ *
+ * window.class reports a string gadget only on Return or when it loses
+ * focus, so the text is also read on every IntuiTick; the list is only
+ * rebuilt when the text has changed.
+ * ========================================================================= */
+
+static void poll_search(void)
+{
+    STRPTR text = NULL;
+    char folded[SEARCH_MAX];
+
+    GetAttr(STRINGA_TextVal, gad_search, (ULONG *)&text);
+    fold_name(folded, text ? (const char *)text : "", SEARCH_MAX);
+
+    if (strcmp(folded, search_text) == 0)
+        return;
+
+    strcpy(search_text, folded);
+    apply_search(folded);
 }
 
 /* =========================================================================
@@ -847,6 +1332,7 @@ static void save_config_from_gadgets(void)
 {
     STRPTR server_str = NULL;
     LONG interval_val = 0;
+    const TZEntry *zone;
 
     /* Get server string */
     GetAttr(STRINGA_TextVal, gad_server, (ULONG *)&server_str);
@@ -859,10 +1345,11 @@ static void save_config_from_gadgets(void)
     config_set_interval(interval_val);
 
     /* Set timezone from current city selection */
-    if (current_city_count > 0 && current_city_idx < current_city_count) {
-        config_set_tz_name(current_cities[current_city_idx]->name);
+    zone = shown_zone(current_city_idx);
+    if (zone) {
+        config_set_tz_name(tz_name(zone));
         /* Update TZ/TZONE environment variables */
-        tz_set_env(current_cities[current_city_idx]);
+        tz_set_env(zone);
     }
 
     config_save();
@@ -925,8 +1412,16 @@ BOOL window_handle_events(SyncConfig *cfg, SyncStatus *st)
                     case GID_CITY:
                         handle_city_change(code);
                         break;
+
+                    case GID_SEARCH:
+                        poll_search();
+                        break;
                 }
                 break;
+
+            case WMHI_INTUITICK:
+                poll_search();
+                break;
         }
     }
 
@@ -934,94 +1429,132 @@ BOOL window_handle_events(SyncConfig *cfg, SyncStatus *st)
 }
 
 /* =========================================================================
- * window_update_status -- refresh the status display gadgets
+ * window_expire -- close the GUI libraries if hidden for GUI_EXPIRE_SECS
  * ========================================================================= */
 
-void window_update_status(SyncStatus *st)
+void window_expire(void)
 {
-    if (!win)
+    ULONG now, micro;
+
+    if (!gui_libs_open || win)
         return;
 
-    /* Copy to static buffers */
-    strcpy(status_buf, st->status_text);
-    strcpy(last_sync_buf, st->last_sync_text);
-    strcpy(next_sync_buf, st->next_sync_text);
+    clock_get_system_time(&now, &micro);
+    if (now - gui_hidden_secs >= GUI_EXPIRE_SECS)
+        close_gui_libraries();
+}
+
+/* =========================================================================
+ * window_cleanup -- close the window and the GUI libraries at exit
+ * ========================================================================= */
+
+void window_cleanup(void)
+{
+    window_close();
+    close_gui_libraries();
+}
+
+/* =========================================================================
+ * window_update_status -- take new status texts for the display
+ *
+ * Only copies the texts and notes which ones changed; the gadgets are
+ * updated by window_refresh(), so several status changes within one
+ * event loop pass cost a single redraw. Safe to call with the window
+ * closed: the buffers are what the gadgets are created from.
+ * ========================================================================= */
+
+void window_update_status(SyncStatus *st)
+{
+    set_field_text(status_buf, st->status_text, DIRTY_STATUS);
+    set_field_text(last_sync_buf, st->last_sync_text, DIRTY_LAST_SYNC);
+    set_field_text(next_sync_buf, st->next_sync_text, DIRTY_NEXT_SYNC);
+    if (st->stats_text[0] != '\0')
+        set_field_text(stats_buf, st->stats_text, DIRTY_STATS);
+}
+
+/* =========================================================================
+ * window_refresh -- push changed display texts to their gadgets
+ *
+ * Called once per event loop pass. Gadgets whose text didn't change
+ * are left alone.
+ * ========================================================================= */
 
-    /* Update gadgets */
-    if (gad_status) {
+void window_refresh(void)
+{
+    if (!win || dirty_fields == 0) {
+        dirty_fields = 0;
+        return;
+    }
+
+    if ((dirty_fields & DIRTY_STATUS) && gad_status) {
         SetGadgetAttrs((struct Gadget *)gad_status, win, NULL,
             STRINGA_TextVal, (ULONG)status_buf, TAG_DONE);
     }
-    if (gad_last_sync) {
+    if ((dirty_fields & DIRTY_LAST_SYNC) && gad_last_sync) {
         SetGadgetAttrs((struct Gadget *)gad_last_sync, win, NULL,
             STRINGA_TextVal, (ULONG)last_sync_buf, TAG_DONE);
     }
-    if (gad_next_sync) {
+    if ((dirty_fields & DIRTY_NEXT_SYNC) && gad_next_sync) {
         SetGadgetAttrs((struct Gadget *)gad_next_sync, win, NULL,
             STRINGA_TextVal, (ULONG)next_sync_buf, TAG_DONE);
     }
+    if ((dirty_fields & DIRTY_STATS) && gad_stats) {
+        SetGadgetAttrs((struct Gadget *)gad_stats, win, NULL,
+            STRINGA_TextVal, (ULONG)stats_buf, TAG_DONE);
+    }
+    if ((dirty_fields & DIRTY_TZ_INFO) && gad_tz_info) {
+        SetGadgetAttrs((struct Gadget *)gad_tz_info, win, NULL,
+            STRINGA_TextVal, (ULONG)tz_info_buf, TAG_DONE);
+    }
+
+    dirty_fields = 0;
 }
 
 /* =========================================================================
- * window_log -- add an entry to the scrollable log (2KB circular buffer)
+ * window_log -- add an entry to the scrollable log (2KB ring buffer)
+ *
+ * The line is copied into the next ring slot, overwriting the oldest
+ * when full. Nothing is allocated unless the log window is open; then
+ * the oldest node is reused for the new line once the ring is full.
  * ========================================================================= */
 
 void window_log(const char *message)
 {
     struct Node *node;
-    char *text_copy;
-    LONG i, len;
-
-    /* Initialize log list if needed (may be called before window_open) */
-    init_log_list();
-
-    /* Calculate message length (capped at LOG_LINE_LEN - 1) */
-    for (len = 0; message[len] != '\0' && len < LOG_LINE_LEN - 1; len++)
-        ;
-
-    /* Allocate text copy (node will own this memory) */
-    text_copy = AllocVec(len + 1, MEMF_ANY);
-    if (!text_copy)
-        return;
-
-    for (i = 0; i < len; i++)
-        text_copy[i] = message[i];
-    text_copy[len] = '\0';
+    char *slot;
+    LONG len;
 
-    /* Create listbrowser node */
-    node = AllocListBrowserNode(1,
-        LBNA_Column, 0,
-        LBNCA_CopyText, TRUE,
-        LBNCA_Text, (ULONG)text_copy,
-        TAG_DONE);
-
-    FreeVec(text_copy);  /* Node made a copy */
-
-    if (!node)
-        return;
+    /* Detach the list while a displayed slot may change */
+    if (log_win && gad_log) {
+        SetGadgetAttrs((struct Gadget *)gad_log, log_win, NULL,
+            LISTBROWSER_Labels, (ULONG)~0,
+            TAG_DONE);
+    }
 
-    /* Circular buffer: remove oldest entries to stay within 2KB limit
-     * We track actual bytes used for accuracy, falling back to count limit */
-    while ((log_bytes_used + len + 1 > LOG_MAX_BYTES || log_count >= LOG_MAX_ENTRIES)
-           && log_count > 0) {
-        struct Node *old = RemHead(&log_browser_list);
-        if (old) {
-            /* Use average line length estimate when removing old entries
-             * (can't easily retrieve old text length from node) */
-            log_bytes_used -= (LOG_LINE_LEN / 2);
-            if (log_bytes_used < 0) log_bytes_used = 0;
-            FreeListBrowserNode(old);
-            log_count--;
-        }
+    /* Take the next free slot, or the oldest one */
+    if (log_count < LOG_MAX_ENTRIES) {
+        slot = log_ring[(log_first + log_count) % LOG_MAX_ENTRIES];
+        log_count++;
+        node = NULL;
+    } else {
+        slot = log_ring[log_first];
+        log_first = (log_first + 1) % LOG_MAX_ENTRIES;
+        node = (log_win && gad_log) ? RemHead(&log_browser_list) : NULL;
     }
 
-    /* Add to end of list */
-    AddTail(&log_browser_list, node);
-    log_count++;
-    log_bytes_used += len + 1;  /* +1 for null terminator */
+    /* Copy message (capped at LOG_LINE_LEN - 1) */
+    for (len = 0; message[len] != '\0' && len < LOG_LINE_LEN - 1; len++)
+        slot[len] = message[len];
+    slot[len] = '\0';
 
     /* Update log window listbrowser if open */
     if (log_win && gad_log) {
+        if (node) {
+            SetListBrowserNodeAttrs(node, LBNCA_Text, (ULONG)slot, TAG_DONE);
+            AddTail(&log_browser_list, node);
+        } else {
+            add_log_node(slot);
+        }
         SetGadgetAttrs((struct Gadget *)gad_log, log_win, NULL,
             LISTBROWSER_Labels, (ULONG)&log_browser_list,
             LISTBROWSER_MakeVisible, log_count - 1,  /* Auto-scroll to bottom */
@@ -0,0 +1,58 @@
+/* host_shim.h - Amiga types for building SyncTime modules natively
+ *
+ * Stands in for the AmigaOS headers when synctime.h is compiled with
+ * -DSYNCTIME_HOST, so the pure modules (sntp.c, tz.c, calendar.c and
+ * the generated tz_table.c) build with the host compiler. Only what
+ * those modules use is declared; host_stubs.c implements the few
+ * dos/exec calls tz.c makes.
+ */
+
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+#include <stdint.h>
+
+typedef uint32_t    ULONG;
+typedef int32_t     LONG;
+typedef uint16_t    UWORD;
+typedef int16_t     WORD;
+typedef uint8_t     UBYTE;
+typedef int8_t      BYTE;
+typedef int16_t     BOOL;
+typedef void       *APTR;
+typedef long        BPTR;
+typedef char       *STRPTR;
+typedef const char *CONST_STRPTR;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+/* dos.library */
+#define MODE_OLDFILE      1005
+#define MODE_READWRITE    1004
+#define OFFSET_BEGINNING  (-1)
+#define OFFSET_END        1
+#define GVF_GLOBAL_ONLY   (1L << 8)
+
+/* exec.library */
+#define MEMF_ANY          0L
+#define MEMF_CLEAR        (1L << 16)
+
+/* Only used as pointers in synctime.h prototypes */
+struct Screen;
+struct Library;
+struct Device;
+struct IntuitionBase;
+struct GfxBase;
+
+BPTR Open(CONST_STRPTR name, LONG mode);
+LONG Close(BPTR fh);
+LONG Read(BPTR fh, APTR buf, LONG len);
+LONG Seek(BPTR fh, LONG pos, LONG mode);
+APTR AllocVec(ULONG size, ULONG flags);
+void FreeVec(APTR block);
+BOOL SetVar(CONST_STRPTR name, CONST_STRPTR buf, LONG size, LONG flags);
+
+#endif /* HOST_SHIM_H */
@@ -0,0 +1,68 @@
+/* host_stubs.c - stdio/malloc versions of the AmigaOS calls tz.c makes
+ *
+ * Open() only succeeds for the data file named by host_tz_file (the
+ * volume part of the Amiga path is ignored), so by default tz.c uses
+ * its built-in table. SetVar() keeps the last TZ value for checks.
+ */
+
+#include "synctime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const char *host_tz_file = NULL;
+char host_tz_var[64];
+
+BPTR Open(CONST_STRPTR name, LONG mode)
+{
+    const char *file = strchr(name, ':');
+
+    (void)mode;
+    if (!host_tz_file || !file || strcmp(file + 1, "SyncTime.tz") != 0)
+        return 0;
+
+    return (BPTR)fopen(host_tz_file, "rb");
+}
+
+LONG Close(BPTR fh)
+{
+    fclose((FILE *)fh);
+    return 1;
+}
+
+LONG Read(BPTR fh, APTR buf, LONG len)
+{
+    return (LONG)fread(buf, 1, (size_t)len, (FILE *)fh);
+}
+
+LONG Seek(BPTR fh, LONG pos, LONG mode)
+{
+    LONG old = (LONG)ftell((FILE *)fh);
+
+    if (fseek((FILE *)fh, pos, mode == OFFSET_BEGINNING ? SEEK_SET :
+                               mode == OFFSET_END ? SEEK_END : SEEK_CUR) != 0)
+        return -1;
+    return old;
+}
+
+APTR AllocVec(ULONG size, ULONG flags)
+{
+    (void)flags;
+    return calloc(1, size);
+}
+
+void FreeVec(APTR block)
+{
+    free(block);
+}
+
+BOOL SetVar(CONST_STRPTR name, CONST_STRPTR buf, LONG size, LONG flags)
+{
+    (void)size;
+    (void)flags;
+    if (strcmp(name, "TZ") == 0) {
+        strncpy(host_tz_var, buf, sizeof(host_tz_var) - 1);
+        host_tz_var[sizeof(host_tz_var) - 1] = '\0';
+    }
+    return TRUE;
+}
@@ -0,0 +1,731 @@
+/* tzbench.c - Host benchmark and regression driver for sntp.c and tz.c
+ *
+ * Built natively by "make host-test" against host_shim.h. It:
+ *
+ *   - times tz_find_by_name(), tz_is_dst_active() and
+ *     tz_get_offset_mins() over every zone for every hour of a range
+ *     of years, zone by zone and hour by hour (zone order changing
+ *     every call, which defeats the DST cache)
+ *   - cross-checks tz_get_offset_mins() and tz_next_transition()
+ *     against the host's zoneinfo through localtime(), and the TZ
+ *     string tz_set_env() writes against the host's POSIX TZ parser
+ *   - times sntp_parse_response() on random and mutated packets and
+ *     checks what it accepts, and checks sntp_compute_sample() on
+ *     synthetic exchanges with known offset and delay
+ *   - checks sntp_filter_samples() on bursts with outliers
+ *   - checks Kiss-of-Death decoding and the broadcast offset
+ *
+ * Usage: tzbench [-f SyncTime.tz] [-y first-last] [-c first-last]
+ *                [-n packets] [-l]
+ *
+ *   -f  use this data file instead of the built-in table
+ *   -y  years to time (default 1980-2037)
+ *   -c  years to compare with zoneinfo (default this year to 2037;
+ *       tz_table only holds the current rules)
+ *   -n  number of fuzzed packets (default 1000000)
+ *   -l  lenient: zoneinfo differences are reported but don't fail the
+ *       run, for hosts whose zoneinfo is older or newer than tz_table
+ *
+ * Exits non-zero if a self-check fails or, unless -l is given, if any
+ * zone outside known_differences[] differs from zoneinfo. Zones the
+ * host has no zoneinfo for are skipped.
+ */
+
+#define _DEFAULT_SOURCE
+#include "synctime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Seconds from Jan 1 1970 (Unix) to Jan 1 1978 (Amiga) */
+#define UNIX_TO_AMIGA  252460800L
+#define MAX_ZONES      1024
+
+extern const char *host_tz_file;
+extern char host_tz_var[];
+
+/* Zones whose current rules the table can't express; their zoneinfo
+ * differences are reported but expected */
+static const char *const known_differences[] = {
+    "Africa/Casablanca",   /* Morocco: DST suspended for Ramadan */
+    "Africa/El_Aaiun",
+    "Asia/Gaza",           /* Palestine: year by year dates */
+    "Asia/Hebron",
+    "America/Santiago",    /* Chile: Sun>=2, not a whole week */
+    "Pacific/Easter",
+    "Asia/Jerusalem",      /* Zion: Fri>=23 */
+    NULL
+};
+
+static const TZEntry *zones[MAX_ZONES];
+static ULONG zone_count = 0;
+static LONG failures = 0;
+static ULONG rng = 2463534242UL;
+
+/* =========================================================================
+ * Helpers
+ * ========================================================================= */
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static ULONG next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void fail(const char *what, const char *detail)
+{
+    printf("FAIL: %s%s%s\n", what, detail ? ": " : "", detail ? detail : "");
+    failures++;
+}
+
+/* UTC Amiga seconds at the start of a year */
+static ULONG year_start(LONG year)
+{
+    return cal_days_from_civil(year, 1, 1) * 86400UL;
+}
+
+static BOOL known_difference(const TZEntry *tz)
+{
+    int i;
+
+    for (i = 0; known_differences[i] != NULL; i++)
+        if (strcmp(tz_name(tz), known_differences[i]) == 0)
+            return TRUE;
+    return FALSE;
+}
+
+/* UTC offset in minutes at an Amiga time under the current host TZ */
+static LONG host_offset_mins(ULONG t)
+{
+    time_t unix_t = (time_t)t + UNIX_TO_AMIGA;
+    struct tm tm;
+
+    localtime_r(&unix_t, &tm);
+    return (LONG)(tm.tm_gmtoff / 60);
+}
+
+/* First second after t, before end, at which the host TZ's offset
+ * changes: an hourly scan, then bisection to the second. 0 if none. */
+static ULONG host_next_transition(ULONG t, ULONG end)
+{
+    LONG off = host_offset_mins(t);
+    ULONG lo = t, hi, mid;
+
+    for (hi = t + 3600; hi < end + 3600; lo = hi, hi += 3600) {
+        if (hi > end)
+            hi = end;
+        if (host_offset_mins(hi) == off)
+            continue;
+        while (hi - lo > 1) {
+            mid = lo + (hi - lo) / 2;
+            if (host_offset_mins(mid) == off)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        return hi;
+    }
+    return 0;
+}
+
+/* Compare tz_next_transition() with the host TZ's instants; prints
+ * the first difference and returns FALSE if there is one */
+static BOOL match_transitions(const TZEntry *tz, ULONG start, ULONG end,
+                              const char *against)
+{
+    ULONG t, ours, host;
+    time_t unix_t;
+    char when[32];
+
+    for (t = start; ; t = ours) {
+        ours = tz_next_transition(tz, t);
+        if (ours >= end)
+            ours = 0;
+        host = host_next_transition(t, end);
+        if (ours != host) {
+            unix_t = (time_t)(ours && (!host || ours < host) ? ours : host) +
+                     UNIX_TO_AMIGA;
+            strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S UTC", gmtime(&unix_t));
+            printf("  %-32s %s: transition %s, %s %s\n", tz_name(tz), when,
+                   (ours && (!host || ours < host)) ? "ours only" : "missing",
+                   "per", against);
+            return FALSE;
+        }
+        if (ours == 0)
+            return TRUE;
+    }
+}
+
+static void parse_range(const char *arg, LONG *first, LONG *last)
+{
+    if (sscanf(arg, "%d-%d", (int *)first, (int *)last) != 2 ||
+        *first < 1978 || *last > 2105 || *first > *last) {
+        fprintf(stderr, "bad year range '%s'\n", arg);
+        exit(2);
+    }
+}
+
+/* Collect every zone through the region API, so a data file works too */
+static void collect_zones(void)
+{
+    const char *const *regions;
+    const TZEntry *cities;
+    ULONG region_count, city_count, r, c;
+
+    regions = tz_get_regions(&region_count);
+    for (r = 0; r < region_count; r++) {
+        cities = tz_get_cities_for_region(regions[r], &city_count);
+        for (c = 0; c < city_count && zone_count < MAX_ZONES; c++)
+            zones[zone_count++] = &cities[c];
+    }
+}
+
+/* =========================================================================
+ * Timezone timing and self-checks
+ * ========================================================================= */
+
+static void bench_tz(LONG first, LONG last)
+{
+    ULONG start = year_start(first), end = year_start(last + 1);
+    ULONG hours = (end - start) / 3600;
+    ULONG z, h, n, sink = 0;
+    const TZEntry *tz;
+    LONG off, std, dst;
+    double t0, t;
+
+    /* Lookup by name */
+    t0 = now_ns();
+    for (n = 0; n < 100; n++) {
+        for (z = 0; z < zone_count; z++) {
+            tz = tz_find_by_name(tz_name(zones[z]));
+            if (n == 0 && tz != zones[z])
+                fail("tz_find_by_name round trip", tz_name(zones[z]));
+        }
+    }
+    t = now_ns() - t0;
+    printf("tz_find_by_name       %8.1f ns/call  (%lu zones)\n",
+           t / (100.0 * zone_count), (unsigned long)zone_count);
+    if (tz_find_by_name("Nowhere/Nothing") != NULL)
+        fail("tz_find_by_name", "unknown zone found");
+    if (tz_find_by_name("") != NULL || tz_find_by_name(NULL) != NULL)
+        fail("tz_find_by_name", "empty name found");
+
+    /* DST state, zone by zone */
+    t0 = now_ns();
+    for (z = 0; z < zone_count; z++)
+        for (h = 0; h < hours; h++)
+            sink += tz_is_dst_active(zones[z], start + h * 3600);
+    t = now_ns() - t0;
+    printf("tz_is_dst_active      %8.1f ns/call  (%d-%d, hourly)\n",
+           t / ((double)zone_count * hours), (int)first, (int)last);
+
+    /* Offset, zone by zone, with range checks */
+    t0 = now_ns();
+    for (z = 0; z < zone_count; z++) {
+        std = zones[z]->std_offset_mins;
+        dst = std + tz_rule(zones[z])->dst_offset_mins;
+        for (h = 0; h < hours; h++) {
+            off = tz_get_offset_mins(zones[z], start + h * 3600);
+            if (off != std && off != dst) {
+                fail("tz_get_offset_mins out of range", tz_name(zones[z]));
+                break;
+            }
+        }
+    }
+    t = now_ns() - t0;
+    printf("tz_get_offset_mins    %8.1f ns/call\n",
+           t / ((double)zone_count * hours));
+
+    /* Offset, changing zone on every call */
+    t0 = now_ns();
+    for (h = 0; h < hours; h += 24)
+        for (z = 0; z < zone_count; z++)
+            sink += (ULONG)tz_get_offset_mins(zones[z], start + h * 3600);
+    t = now_ns() - t0;
+    printf("  interleaved zones   %8.1f ns/call\n",
+           t / ((double)zone_count * (hours / 24 + 1)));
+
+    if (tz_get_offset_mins(NULL, start) != 0)
+        fail("tz_get_offset_mins", "NULL zone is not UTC");
+    if (tz_set_env(zones[0]) == FALSE || host_tz_var[0] == '\0')
+        fail("tz_set_env", tz_name(zones[0]));
+
+    if (sink == 0xFFFFFFFFUL)
+        printf("\n");  /* Keep the loops from being optimised away */
+}
+
+/* =========================================================================
+ * Cross-check against the host's zoneinfo
+ * ========================================================================= */
+
+static LONG crosscheck_tz(LONG first, LONG last)
+{
+    ULONG start = year_start(first), end = year_start(last + 1);
+    ULONG z, t, bad, bad_zones = 0, known = 0, skipped = 0;
+    char path[256];
+    time_t unix_t;
+    struct tm tm;
+    LONG ours, host;
+
+    for (z = 0; z < zone_count; z++) {
+        snprintf(path, sizeof(path), "/usr/share/zoneinfo/%s", tz_name(zones[z]));
+        if (access(path, R_OK) != 0) {
+            skipped++;
+            continue;
+        }
+        setenv("TZ", tz_name(zones[z]), 1);
+        tzset();
+
+        bad = 0;
+        for (t = start; t < end; t += 3600) {
+            unix_t = (time_t)t + UNIX_TO_AMIGA;
+            localtime_r(&unix_t, &tm);
+            host = (LONG)(tm.tm_gmtoff / 60);
+            ours = tz_get_offset_mins(zones[z], t);
+            if (ours != host && bad++ == 0) {
+                char when[32];
+                strftime(when, sizeof(when), "%Y-%m-%d %H:%M UTC", gmtime(&unix_t));
+                printf("  %-32s %s: ours %+d, zoneinfo %+d\n",
+                       tz_name(zones[z]), when, (int)ours, (int)host);
+            }
+        }
+        if (bad) {
+            printf("  %-32s %lu of %lu hours differ\n", tz_name(zones[z]),
+                   (unsigned long)bad, (unsigned long)((end - start) / 3600));
+            if (known_difference(zones[z]))
+                known++;
+            else
+                bad_zones++;
+        }
+    }
+    unsetenv("TZ");
+    tzset();
+
+    printf("zoneinfo %d-%d          %lu of %lu zones differ, %lu known, "
+           "%lu not on host\n", (int)first, (int)last,
+           (unsigned long)bad_zones, (unsigned long)zone_count,
+           (unsigned long)known, (unsigned long)skipped);
+    return (LONG)bad_zones;
+}
+
+/*
+ * Compare each zone's transitions over the range with zoneinfo's
+ * instants, to the second, and with those of the POSIX TZ string
+ * tz_set_env() writes for it. Returns the zones that differ from
+ * zoneinfo, not counting known_differences[]; the TZ string must
+ * always agree, since it holds the same rule.
+ */
+static LONG crosscheck_transitions(LONG first, LONG last)
+{
+    ULONG start = year_start(first), end = year_start(last + 1);
+    ULONG z, bad_zones = 0, known = 0;
+    char path[256];
+
+    for (z = 0; z < zone_count; z++) {
+        snprintf(path, sizeof(path), "/usr/share/zoneinfo/%s", tz_name(zones[z]));
+        if (access(path, R_OK) == 0) {
+            setenv("TZ", tz_name(zones[z]), 1);
+            tzset();
+            if (!match_transitions(zones[z], start, end, "zoneinfo")) {
+                if (known_difference(zones[z]))
+                    known++;
+                else
+                    bad_zones++;
+            }
+        }
+
+        if (!tz_set_env(zones[z])) {
+            fail("tz_set_env", tz_name(zones[z]));
+            continue;
+        }
+        setenv("TZ", host_tz_var, 1);
+        tzset();
+        if (!match_transitions(zones[z], start, end, host_tz_var))
+            fail("tz_set_env TZ string", tz_name(zones[z]));
+    }
+    unsetenv("TZ");
+    tzset();
+
+    printf("transitions %d-%d       %lu of %lu zones differ, %lu known\n",
+           (int)first, (int)last, (unsigned long)bad_zones,
+           (unsigned long)zone_count, (unsigned long)known);
+    return (LONG)bad_zones;
+}
+
+/* Walk each zone's transitions over the range: the offset must be
+ * constant up to each one and change exactly there */
+static void check_tz_transitions(LONG first, LONG last)
+{
+    ULONG start = year_start(first), end = year_start(last + 1);
+    ULONG z, t, next, count = 0;
+
+    for (z = 0; z < zone_count; z++) {
+        for (t = start; t < end; t = next) {
+            next = tz_next_transition(zones[z], t);
+            if (next == 0) {
+                if (tz_get_offset_mins(zones[z], start) !=
+                    tz_get_offset_mins(zones[z], end - 1)) {
+                    fail("tz_next_transition", tz_name(zones[z]));
+                }
+                break;
+            }
+            if (next <= t ||
+                tz_get_offset_mins(zones[z], next - 1) == tz_get_offset_mins(zones[z], next) ||
+                tz_get_offset_mins(zones[z], t) != tz_get_offset_mins(zones[z], next - 1) ||
+                tz_get_offset_mins(zones[z], t + (next - t) / 2) != tz_get_offset_mins(zones[z], t)) {
+                fail("tz_next_transition", tz_name(zones[z]));
+                break;
+            }
+            count++;
+        }
+    }
+    printf("tz_next_transition    %s, %lu transitions\n",
+           failures ? "FAILED" : "ok", (unsigned long)count);
+}
+
+/* =========================================================================
+ * SNTP parsing and sample math
+ * ========================================================================= */
+
+static void put_be32(UBYTE *p, ULONG v)
+{
+    p[0] = (UBYTE)(v >> 24);
+    p[1] = (UBYTE)(v >> 16);
+    p[2] = (UBYTE)(v >> 8);
+    p[3] = (UBYTE)v;
+}
+
+/* Store an Amiga UTC time, given in microseconds, as an NTP timestamp */
+static void put_ntp(UBYTE *p, long long amiga_us)
+{
+    put_be32(p, (ULONG)(amiga_us / 1000000 + NTP_TO_AMIGA_EPOCH));
+    put_be32(p + 4, (ULONG)(((amiga_us % 1000000) << 32) / 1000000));
+}
+
+static void bench_sntp(ULONG count)
+{
+    UBYTE packet[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    ULONG n, i, accepted = 0;
+    double t0, t;
+
+    t0 = now_ns();
+    for (n = 0; n < count; n++) {
+        for (i = 0; i < NTP_PACKET_SIZE; i += 4)
+            put_be32(packet + i, next_rand());
+        /* Half the packets get a plausible header so the later checks run */
+        if (n & 1) {
+            packet[0] = (packet[0] & 0xF8) | 4;
+            packet[1] |= 1;
+        }
+        if (sntp_parse_response(packet, &resp)) {
+            accepted++;
+            if ((resp.mode != 4 && resp.mode != 5) || resp.stratum == 0 ||
+                (packet[0] >> 6) == 3 || resp.transmit.secs == 0) {
+                fail("sntp_parse_response", "accepted an invalid packet");
+                break;
+            }
+        }
+    }
+    t = now_ns() - t0;
+    printf("sntp_parse_response   %8.1f ns/call  (%lu packets, %lu accepted)\n",
+           t / count, (unsigned long)count, (unsigned long)accepted);
+}
+
+static void check_sntp_samples(void)
+{
+    UBYTE request[NTP_PACKET_SIZE], reply[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    SNTPSample sample;
+    AmigaTime t1, t4;
+    long long t1_us, off_us, delay_us, got_off, err;
+    ULONG n, worst = 0;
+
+    for (n = 0; n < 100000; n++) {
+        t1_us    = (long long)(next_rand() % 1500000000UL) * 1000000 + next_rand() % 1000000;
+        off_us   = (long long)(next_rand() % 2000000000UL) - 1000000000LL;
+        delay_us = next_rand() % 2000000;
+
+        t1.secs  = (ULONG)(t1_us / 1000000);
+        t1.micro = (ULONG)(t1_us % 1000000);
+        sntp_build_request(request, &t1);
+
+        /* Server clock = ours + off; it holds the request for 1 ms */
+        memset(reply, 0, sizeof(reply));
+        reply[0] = (NTP_VERSION << 3) | 4;
+        reply[1] = 2;
+        memcpy(reply + 24, request + 40, 8);
+        put_ntp(reply + 32, t1_us + off_us + delay_us / 2);
+        put_ntp(reply + 40, t1_us + off_us + delay_us / 2 + 1000);
+
+        t4.secs  = (ULONG)((t1_us + delay_us + 1000) / 1000000);
+        t4.micro = (ULONG)((t1_us + delay_us + 1000) % 1000000);
+
+        if (!sntp_parse_response(reply, &resp) ||
+            !sntp_compute_sample(&resp, &t1, &t1, &t4, NULL, &sample)) {
+            fail("sntp_compute_sample", "rejected a matching reply");
+            return;
+        }
+
+        /* The NTP fraction decode truncates to about 16us */
+        got_off = (long long)sample.offset.secs * 1000000 + sample.offset.micro;
+        err = got_off - off_us;
+        if (err < 0) err = -err;
+        if (err > worst) worst = (ULONG)err;
+        if (err > 40 || sample.delay_micro < delay_us - 40 ||
+            sample.delay_micro > delay_us + 40) {
+            fail("sntp_compute_sample", "offset or delay wrong");
+            return;
+        }
+
+        /* A reply to some other request must not match */
+        reply[31] ^= 0x10;
+        if (sntp_parse_response(reply, &resp) &&
+            sntp_compute_sample(&resp, &t1, &t1, &t4, NULL, &sample)) {
+            fail("sntp_compute_sample", "accepted a foreign origin");
+            return;
+        }
+    }
+    printf("sntp_compute_sample   ok, worst offset error %lu us\n",
+           (unsigned long)worst);
+}
+
+/* Helper to fill a sample from ms values */
+static void make_sample(SNTPSample *s, LONG offset_ms, LONG delay_ms)
+{
+    LONG micro = offset_ms * 1000;
+
+    s->offset.secs  = micro >= 0 ? micro / 1000000 : -((999999 - micro) / 1000000);
+    s->offset.micro = (ULONG)(micro - s->offset.secs * 1000000);
+    s->delay_micro  = delay_ms * 1000;
+    s->stratum      = 2;
+}
+
+static void check_sntp_filter(void)
+{
+    SNTPSample burst[MAX_BURST], best;
+    LONG agree;
+
+    /* One reply held up in a queue: slow, and off by half its extra
+     * delay, which is still within its own error bound */
+    make_sample(&burst[0], 10, 20);
+    make_sample(&burst[1], 11, 22);
+    make_sample(&burst[2], 160, 320);
+    make_sample(&burst[3], 9, 25);
+    agree = sntp_filter_samples(burst, 4, &best);
+    if (agree != 4 || best.delay_micro != 20000)
+        fail("sntp_filter_samples", "delayed sample");
+
+    /* A server answering with a stepped clock */
+    make_sample(&burst[2], 900, 21);
+    agree = sntp_filter_samples(burst, 4, &best);
+    if (agree != 3 || best.delay_micro != 20000)
+        fail("sntp_filter_samples", "wrong clock");
+
+    /* A fast reply that disagrees with everything else */
+    make_sample(&burst[0], 200, 5);
+    make_sample(&burst[1], 10, 30);
+    make_sample(&burst[2], 12, 31);
+    make_sample(&burst[3], 11, 33);
+    agree = sntp_filter_samples(burst, 4, &best);
+    if (agree != 3 || best.delay_micro != 30000)
+        fail("sntp_filter_samples", "fast outlier");
+
+    /* No majority: lowest delay wins */
+    make_sample(&burst[0], -500, 40);
+    make_sample(&burst[1], 500, 10);
+    agree = sntp_filter_samples(burst, 2, &best);
+    if (agree != 1 || best.delay_micro != 10000)
+        fail("sntp_filter_samples", "two disagreeing samples");
+
+    if (sntp_filter_samples(burst, 0, &best) != 0)
+        fail("sntp_filter_samples", "empty burst");
+
+    printf("sntp_filter_samples   %s\n", failures ? "FAILED" : "ok");
+}
+
+static void check_sntp_kiss(void)
+{
+    static const struct { const char *code; UBYTE kiss; } codes[] = {
+        { "RATE", KISS_RATE }, { "DENY", KISS_DENY },
+        { "RSTR", KISS_RSTR }, { "INIT", KISS_OTHER }
+    };
+    UBYTE request[NTP_PACKET_SIZE], reply[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    AmigaTime t1 = { 1500000000UL, 250000 };
+    LONG i;
+
+    sntp_build_request(request, &t1);
+    for (i = 0; i < 4; i++) {
+        memset(reply, 0, sizeof(reply));
+        reply[0] = (NTP_VERSION << 3) | 4;
+        reply[2] = 10;
+        memcpy(reply + 12, codes[i].code, 4);
+        memcpy(reply + 24, request + 40, 8);
+
+        if (sntp_parse_response(reply, &resp))
+            fail("sntp_parse_response", "accepted a kiss");
+        if (sntp_parse_kiss(reply, &resp) != codes[i].kiss)
+            fail("sntp_parse_kiss", codes[i].code);
+        if (!sntp_matches_request(&resp, &t1) || sntp_poll_secs(&resp) != 1024)
+            fail("sntp_parse_kiss", "origin or poll");
+    }
+
+    reply[1] = 2;
+    if (sntp_parse_kiss(reply, &resp) != KISS_NONE)
+        fail("sntp_parse_kiss", "stratum 2 taken as a kiss");
+
+    printf("sntp_parse_kiss       %s\n", failures ? "FAILED" : "ok");
+}
+
+static void check_sntp_broadcast(void)
+{
+    UBYTE packet[NTP_PACKET_SIZE];
+    SNTPResponse resp;
+    SNTPSample sample;
+    AmigaTime t4 = { 1500000000UL, 100000 };
+    long long t4_us = 1500000000LL * 1000000 + 100000, got;
+
+    /* Server clock 250 ms behind ours, packet 3 ms on the way */
+    memset(packet, 0, sizeof(packet));
+    packet[0] = (NTP_VERSION << 3) | NTP_MODE_BROADCAST;
+    packet[1] = 2;
+    put_ntp(packet + 40, t4_us - 3000 - 250000);
+
+    if (!sntp_parse_response(packet, &resp)) {
+        fail("sntp_parse_response", "rejected a broadcast");
+        return;
+    }
+    sntp_compute_broadcast(&resp, &t4, 3000, NULL, &sample);
+    got = (long long)sample.offset.secs * 1000000 + sample.offset.micro;
+    if (got < -250020 || got > -249980 || sample.delay_micro != 6000)
+        fail("sntp_compute_broadcast", "offset or delay wrong");
+
+    printf("sntp_compute_broadcast %s\n", failures ? "FAILED" : "ok");
+}
+
+static void check_sntp_reply(void)
+{
+    UBYTE request[NTP_PACKET_SIZE], reply[NTP_PACKET_SIZE];
+    SNTPServerInfo info;
+    SNTPResponse resp;
+    SNTPSample sample;
+    AmigaTime t1 = { 1500000000UL, 990000 };
+    AmigaTime t2 = { 1500000000UL, 995000 };
+    AmigaTime t3 = { 1500000000UL, 996000 };
+    AmigaTime t4 = { 1500000001UL, 0 };
+    ULONG i, local, base = year_start(2026);
+    LONG got;
+
+    /* Our own reply fed back through the client side: 5 ms there,
+     * 4 ms back, 1 ms in the server */
+    memset(&info, 0, sizeof(info));
+    info.stratum = 3;
+    info.precision = -17;
+    info.refid = 0x0A000001UL;
+    info.ref_time = t1;
+    sntp_build_request(request, &t1);
+    if (!sntp_build_reply(reply, request, &info, NULL, &t2, &t3) ||
+        !sntp_parse_response(reply, &resp)) {
+        fail("sntp_build_reply", "reply not accepted");
+        return;
+    }
+    if (!sntp_compute_sample(&resp, &t1, &t1, &t4, NULL, &sample)) {
+        fail("sntp_build_reply", "origin not echoed");
+        return;
+    }
+    got = sntp_offset_to_micro(&sample.offset);
+    if (got < 490 || got > 510 || sample.delay_micro < 8990 ||
+        sample.delay_micro > 9010 || sample.stratum != 3)
+        fail("sntp_build_reply", "offset, delay or stratum wrong");
+
+    info.leap = 3;
+    info.stratum = 16;
+    sntp_build_reply(reply, request, &info, NULL, &t2, &t3);
+    if (sntp_parse_response(reply, &resp))
+        fail("sntp_build_reply", "unsynchronized reply accepted");
+    if (sntp_build_reply(reply, reply, &info, NULL, &t2, &t3))
+        fail("sntp_build_reply", "answered a server reply");
+
+    /* Local time back to NTP, away from DST changes */
+    for (i = 0; i < zone_count; i++) {
+        local = sntp_ntp_to_amiga(base + 14 * 86400UL + NTP_TO_AMIGA_EPOCH, zones[i]);
+        if (sntp_ntp_to_amiga(sntp_amiga_to_ntp(local, zones[i]), zones[i]) != local)
+            fail("sntp_amiga_to_ntp", tz_name(zones[i]));
+        local += 181 * 86400UL;
+        if (sntp_ntp_to_amiga(sntp_amiga_to_ntp(local, zones[i]), zones[i]) != local)
+            fail("sntp_amiga_to_ntp", tz_name(zones[i]));
+    }
+
+    printf("sntp_build_reply      %s\n", failures ? "FAILED" : "ok");
+}
+
+/* =========================================================================
+ * main
+ * ========================================================================= */
+
+int main(int argc, char **argv)
+{
+    LONG first = 1980, last = 2037, cfirst, clast = 2037;
+    ULONG packets = 1000000;
+    BOOL lenient = FALSE;
+    time_t now = time(NULL);
+    LONG bad_zones;
+    int opt;
+
+    cfirst = gmtime(&now)->tm_year + 1900;
+    if (cfirst > clast)
+        clast = cfirst;
+
+    while ((opt = getopt(argc, argv, "f:y:c:n:l")) != -1) {
+        switch (opt) {
+            case 'f': host_tz_file = optarg; break;
+            case 'y': parse_range(optarg, &first, &last); break;
+            case 'c': parse_range(optarg, &cfirst, &clast); break;
+            case 'n': packets = (ULONG)strtoul(optarg, NULL, 10); break;
+            case 'l': lenient = TRUE; break;
+            default:
+                fprintf(stderr, "usage: %s [-f SyncTime.tz] [-y first-last] "
+                        "[-c first-last] [-n packets] [-l]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    tz_init();
+    collect_zones();
+    if (zone_count == 0) {
+        fail("zone table", "empty");
+        return 1;
+    }
+
+    bench_tz(first, last);
+    bad_zones = crosscheck_tz(cfirst, clast);
+    check_tz_transitions(first, last);
+    bad_zones += crosscheck_transitions(cfirst, clast);
+    if (packets > 0)
+        bench_sntp(packets);
+    check_sntp_samples();
+    check_sntp_filter();
+    check_sntp_kiss();
+    check_sntp_broadcast();
+    check_sntp_reply();
+
+    tz_cleanup();
+
+    if (bad_zones > 0 && !lenient)
+        fail("zoneinfo", "zones differ, see above");
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}